@@ -0,0 +1,309 @@
+// This file is part of the knapsack project and distributed under the
+// terms of the GNU General Public License v2.
+// SPDX-License-Identifier: GPL-2.0-only
+//
+// Copyright (c)
+//   Martin Väth <martin@mvath.de>
+
+// The benchmark of "make bench": Generate reproducible instances of several
+// families and sizes, solve each with the library in a child process, and
+// print one line of name=value pairs per instance: the engine actually used
+// (with -e auto, the families of one knapsack typically do not use the hash
+// engine, so their counts of states are 0), the maximal value, the seconds,
+// the peak resident memory of the child, and get_stats().
+// The arguments select the families (default: all); options are
+//   -e ENGINE  auto, hash, dense, or bitset (see set_engine())
+//   -j N       use N threads (see set_threads())
+//   -p         use set_prune(true)
+//   -l         only list the families and sizes
+
+#include <boost/cstdint.hpp>  // boost::uint64_t, UINT64_C
+#include <boost/format.hpp>  // boost::format
+
+#include <sys/resource.h>  // struct rusage
+#include <sys/types.h>  // pid_t
+#include <sys/wait.h>  // wait4
+#include <unistd.h>  // fork, getopt, _exit
+
+#include <cstdlib>  // std::size_t, std::atoi
+#include <cstdio>  // std::fputs, std::fflush, stdout, stderr
+#include <cstring>  // std::strcmp
+
+#include <string>
+#include <vector>
+
+#include "knapsack/knapsack.h"
+#include "knapsack/nullptr.h"
+
+typedef Knapsack<boost::uint64_t, boost::uint64_t, boost::uint64_t>
+  KnapsackBench;
+
+// A reproducible sequence of pseudo random numbers (xorshift64*)
+class BenchRandom {
+ public:
+  explicit BenchRandom(boost::uint64_t seed)
+    : state_(seed * UINT64_C(0x9E3779B97F4A7C15) + 1) {
+  }
+
+  // A number in [low, high]
+  boost::uint64_t Uniform(boost::uint64_t low, boost::uint64_t high) {
+    state_ ^= state_ >> 12;
+    state_ ^= state_ << 25;
+    state_ ^= state_ >> 27;
+    return low + (state_ * UINT64_C(0x2545F4914F6CDD1D)) % (high - low + 1);
+  }
+
+ private:
+  boost::uint64_t state_;
+};
+
+enum BenchFamily {
+  kBenchUncorrelated,
+  kBenchWeak,
+  kBenchStrong,
+  kBenchSubsetSum,
+  kBenchIdentical,
+  kBenchLargeCount,
+  kBenchUnbound
+};
+
+// An instance of the benchmark: items items of the family in sacks
+// knapsacks, with weights up to range
+class BenchCase {
+ public:
+  const char *family_;
+  BenchFamily kind_;
+  std::size_t sacks_, items_;
+  boost::uint64_t range_;
+
+  BenchCase(const char *family, BenchFamily kind, std::size_t sacks,
+      std::size_t items, boost::uint64_t range)
+    : family_(family), kind_(kind), sacks_(sacks), items_(items),
+    range_(range) {
+  }
+};
+
+typedef std::vector<BenchCase> BenchList;
+
+static void BenchCases(BenchList *list);
+static void BenchGenerate(const BenchCase& bench, boost::uint64_t seed,
+  KnapsackBench *knapsack);
+static std::string BenchName(const BenchCase& bench);
+static const char *BenchEngine(KnapsackBase::Engine engine);
+static void BenchRun(const BenchCase& bench, const KnapsackBench& settings);
+static bool BenchMeasure(const BenchCase& bench,
+  const KnapsackBench& settings);
+static bool BenchSelected(const BenchCase& bench, int argc, char *argv[]);
+static void BenchUsage();
+
+// The families and their sizes. The sizes are chosen so that the whole
+// benchmark runs in some seconds; the largest size of each family is the
+// one which is meant to show regressions.
+static void BenchCases(BenchList *list) {
+  static const std::size_t kItems[] = { 50, 200, 800 };
+  for (std::size_t i(0); i != 3; ++i) {
+    list->push_back(BenchCase("uncorrelated", kBenchUncorrelated, 1,
+      kItems[i], 1000));
+    list->push_back(BenchCase("weakly_correlated", kBenchWeak, 1,
+      kItems[i], 1000));
+    list->push_back(BenchCase("strongly_correlated", kBenchStrong, 1,
+      kItems[i], 1000));
+    list->push_back(BenchCase("subset_sum", kBenchSubsetSum, 1,
+      kItems[i], 2000));
+  }
+  static const std::size_t kSacks[] = { 3, 5, 8 };
+  static const std::size_t kSackItems[] = { 10, 14, 18 };
+  for (std::size_t i(0); i != 3; ++i) {
+    list->push_back(BenchCase("identical_sacks", kBenchIdentical, kSacks[i],
+      kSackItems[i], 100));
+  }
+  for (std::size_t i(0); i != 3; ++i) {
+    list->push_back(BenchCase("large_count", kBenchLargeCount, 1,
+      kSackItems[i] / 2, 100));
+    list->push_back(BenchCase("unbound_heavy", kBenchUnbound, 3,
+      kSackItems[i], 100));
+  }
+}
+
+// Fill knapsack with the instance of bench for seed
+static void BenchGenerate(const BenchCase& bench, boost::uint64_t seed,
+    KnapsackBench *knapsack) {
+  BenchRandom random(seed);
+  boost::uint64_t range(bench.range_), total(0);
+  for (std::size_t i(0); i != bench.items_; ++i) {
+    boost::uint64_t weight(random.Uniform(1, range)), value, count(1);
+    switch (bench.kind_) {
+      case kBenchWeak:
+        value = weight + range / 10 + random.Uniform(0, range / 5);
+        value = ((value > range / 5) ? (value - range / 5) : 1);
+        break;
+      case kBenchStrong:
+        value = weight + range / 10;
+        break;
+      case kBenchSubsetSum:
+        value = 0;  // the value is the weight
+        break;
+      case kBenchLargeCount:
+        count = random.Uniform(20, 200);
+        value = random.Uniform(1, range);
+        break;
+      case kBenchUnbound:
+        count = ((random.Uniform(0, 3) == 0) ? 1 : 0);
+        value = random.Uniform(1, range);
+        break;
+      case kBenchUncorrelated:
+      case kBenchIdentical:
+      default:
+        value = random.Uniform(1, range);
+        break;
+    }
+    knapsack->weight_.push_back(weight);
+    knapsack->value_.push_back(value);
+    knapsack->count_.push_back(count);
+    total += weight * ((count == 0) ? 1 : count);
+  }
+  // The knapsacks hold about half of the items (for the unbound items,
+  // about half of one copy of each); they are equal for kBenchIdentical
+  for (std::size_t i(0); i != bench.sacks_; ++i) {
+    boost::uint64_t capacity(total / 2 / bench.sacks_);
+    if ((bench.kind_ != kBenchIdentical) && (bench.sacks_ > 1)) {
+      capacity = random.Uniform(capacity / 2, capacity + capacity / 2);
+    }
+    knapsack->knapsack_.push_back((capacity < range) ? range : capacity);
+  }
+}
+
+static std::string BenchName(const BenchCase& bench) {
+  return (boost::format("family=%s sacks=%s items=%s range=%s") %
+    bench.family_ % bench.sacks_ % bench.items_ % bench.range_).str();
+}
+
+// The name of engine as for option -e; "none" for kEngineAuto which is
+// returned by engine_used() if no engine was needed
+static const char *BenchEngine(KnapsackBase::Engine engine) {
+  switch (engine) {
+    case KnapsackBase::kEngineHash:
+      return "hash";
+    case KnapsackBase::kEngineDense:
+      return "dense";
+    case KnapsackBase::kEngineBitset:
+      return "bitset";
+    case KnapsackBase::kEngineAuto:
+    default:
+      return "none";
+  }
+}
+
+// Solve the instance of bench with the settings of settings and print
+// the line of name=value pairs (without the peak memory)
+static void BenchRun(const BenchCase& bench, const KnapsackBench& settings) {
+  KnapsackBench knapsack;
+  knapsack.set_engine(settings.get_engine());
+  knapsack.set_threads(settings.get_threads());
+  knapsack.set_prune(settings.get_prune());
+  BenchGenerate(bench, bench.sacks_ * 1000003 + bench.items_, &knapsack);
+  KnapsackDeadline clock(-1, KNAPSACK_NULLPTR, KNAPSACK_NULLPTR);
+  KnapsackBench::value_type value(knapsack.Solve());
+  double seconds(clock.Elapsed());
+  std::string line(BenchName(bench));
+  line.append((boost::format(" engine=%s value=%s seconds=%.6f ") %
+    BenchEngine(knapsack.engine_used()) % value % seconds).str());
+  knapsack.get_stats().Append(&line);
+  std::fputs(line.c_str(), stdout);
+  std::fflush(stdout);
+}
+
+// Run BenchRun() in a child process and append its peak memory;
+// return false if the child failed
+static bool BenchMeasure(const BenchCase& bench,
+    const KnapsackBench& settings) {
+  std::fflush(stdout);
+  pid_t pid(fork());
+  if (pid < 0) {
+    std::fputs("bench: cannot fork\n", stderr);
+    return false;
+  }
+  if (pid == 0) {
+    BenchRun(bench, settings);
+    _exit(0);
+  }
+  int status;
+  struct rusage usage;
+  if ((wait4(pid, &status, 0, &usage) != pid) || !WIFEXITED(status) ||
+    (WEXITSTATUS(status) != 0)) {
+    std::printf("%s failed\n", BenchName(bench).c_str());
+    return false;
+  }
+  // ru_maxrss is in kilobytes
+  std::printf(" peak_rss_bytes=%lu\n",  // NOLINT(runtime/printf)
+    static_cast<unsigned long>(usage.ru_maxrss) * 1024);  // NOLINT
+  return true;
+}
+
+static bool BenchSelected(const BenchCase& bench, int argc, char *argv[]) {
+  if (optind == argc) {
+    return true;
+  }
+  for (int i(optind); i != argc; ++i) {
+    if (std::strcmp(argv[i], bench.family_) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void BenchUsage() {
+  std::fputs("Usage: bench [-e engine] [-j threads] [-p] [-l] "
+    "[family ...]\n", stderr);
+  std::exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+  KnapsackBench settings;
+  bool list_only(false);
+  int option;
+  while ((option = getopt(argc, argv, "e:j:pl")) != -1) {
+    switch (option) {
+      case 'e':
+        if (std::strcmp(optarg, "auto") == 0) {
+          settings.set_engine(KnapsackBase::kEngineAuto);
+        } else if (std::strcmp(optarg, "hash") == 0) {
+          settings.set_engine(KnapsackBase::kEngineHash);
+        } else if (std::strcmp(optarg, "dense") == 0) {
+          settings.set_engine(KnapsackBase::kEngineDense);
+        } else if (std::strcmp(optarg, "bitset") == 0) {
+          settings.set_engine(KnapsackBase::kEngineBitset);
+        } else {
+          BenchUsage();
+        }
+        break;
+      case 'j':
+        settings.set_threads(static_cast<unsigned int>(std::atoi(optarg)));
+        break;
+      case 'p':
+        settings.set_prune(true);
+        break;
+      case 'l':
+        list_only = true;
+        break;
+      default:
+        BenchUsage();
+    }
+  }
+  BenchList list;
+  BenchCases(&list);
+  bool success(true);
+  for (BenchList::const_iterator it(list.begin()); it != list.end(); ++it) {
+    if (!BenchSelected(*it, argc, argv)) {
+      continue;
+    }
+    if (list_only) {
+      std::printf("%s\n", BenchName(*it).c_str());
+      continue;
+    }
+    if (!BenchMeasure(*it, settings)) {
+      success = false;
+    }
+  }
+  return (success ? EXIT_SUCCESS : EXIT_FAILURE);
+}
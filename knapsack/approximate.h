@@ -0,0 +1,113 @@
+// This file is part of the knapsack project and distributed under the
+// terms of the GNU General Public License v2.
+// SPDX-License-Identifier: GPL-2.0-only
+//
+// Copyright (c)
+//   Martin Väth <martin@mvath.de>
+
+#ifndef KNAPSACK_APPROXIMATE_H_
+#define KNAPSACK_APPROXIMATE_H_ 1
+
+#include <boost/cstdint.hpp>  // boost::uint64_t
+
+#include <cstdlib>  // std::size_t
+
+#include <vector>
+
+// The dynamic programming by profits for one knapsack which is used for the
+// approximation scheme of Knapsack (see set_epsilon()): The items are added
+// with integral (scaled) profits, and for each total profit p, the minimal
+// weight of a set of the items added so far with profit p is stored.
+// Each item can be used at most once (the caller splits counts into bundles).
+// The runtime is the number of items times the maximal total profit, and
+// the decisions need one bit for each item and total profit.
+
+template <class Weight, class Allocator>
+class KnapsackApproximate {
+ public:
+  typedef Weight weight_type;
+  typedef std::size_t size_type;
+
+  // Only total profits up to max_profit are considered
+  KnapsackApproximate(weight_type capacity, size_type max_profit,
+      const Allocator& allocator)
+    : capacity_(capacity), profits_(max_profit + 1),
+    words_((profits_ + kWordBits - 1) / kWordBits),
+    weight_(profits_, capacity, WeightAllocator(allocator)),
+    reachable_(words_, boost::uint64_t(0), WordAllocator(allocator)),
+    profit_(SizeAllocator(allocator)), bits_(WordAllocator(allocator)) {
+    weight_[0] = 0;
+    reachable_[0] = 1;
+  }
+
+  // Add an item with weight (at most the capacity) and profit
+  void Add(weight_type weight, size_type profit) {
+    size_type item(profit_.size());
+    profit_.push_back(profit);
+    bits_.resize((item + 1) * words_, boost::uint64_t(0));
+    boost::uint64_t *take(&bits_[item * words_]);
+    for (size_type p(profits_); p > profit; ) {
+      --p;
+      size_type from(p - profit);
+      if (!Reachable(from) || (weight > capacity_ - weight_[from])) {
+        continue;
+      }
+      weight_type placed(weight_[from] + weight);
+      if (!Reachable(p) || (placed < weight_[p])) {
+        weight_[p] = placed;
+        reachable_[p / kWordBits] |= (boost::uint64_t(1) << (p % kWordBits));
+        take[p / kWordBits] |= (boost::uint64_t(1) << (p % kWordBits));
+      }
+    }
+  }
+
+  // The largest total profit which can be reached
+  size_type Best() const {
+    size_type p(profits_);
+    while (!Reachable(--p)) {
+    }
+    return p;
+  }
+
+  size_type get_profit(size_type item) const {
+    return profit_[item];
+  }
+
+  // Whether item is used for the total profit p with the items up to item.
+  // The items of Best() are obtained by testing the items in reverse order,
+  // subtracting the profit of each used item from p.
+  bool Taken(size_type item, size_type p) const {
+    return (((bits_[item * words_ + p / kWordBits] >> (p % kWordBits)) & 1)
+      != 0);
+  }
+
+ private:
+  typedef typename Allocator::template rebind<weight_type>::other
+    WeightAllocator;
+  typedef typename Allocator::template rebind<size_type>::other
+    SizeAllocator;
+  typedef typename Allocator::template rebind<boost::uint64_t>::other
+    WordAllocator;
+  typedef std::vector<weight_type, WeightAllocator> WeightList;
+  typedef std::vector<size_type, SizeAllocator> SizeList;
+  typedef std::vector<boost::uint64_t, WordAllocator> WordList;
+
+  static const size_type kWordBits = 64;
+
+  weight_type capacity_;
+  size_type profits_, words_;
+  WeightList weight_;  // the minimal weight for each total profit
+  WordList reachable_;  // the total profits reached so far (as bits)
+  SizeList profit_;
+  WordList bits_;  // the decisions: a row of profits_ bits for each item
+
+  bool Reachable(size_type p) const {
+    return (((reachable_[p / kWordBits] >> (p % kWordBits)) & 1) != 0);
+  }
+
+  // This class is not meant to be copied
+  KnapsackApproximate(const KnapsackApproximate&);
+  KnapsackApproximate& operator=(const KnapsackApproximate&);
+};
+
+#endif  // KNAPSACK_APPROXIMATE_H_
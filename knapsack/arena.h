@@ -0,0 +1,271 @@
+// This file is part of the knapsack project and distributed under the
+// terms of the GNU General Public License v2.
+// SPDX-License-Identifier: GPL-2.0-only
+//
+// Copyright (c)
+//   Martin Väth <martin@mvath.de>
+
+#ifndef KNAPSACK_ARENA_H_
+#define KNAPSACK_ARENA_H_ 1
+
+#include <cstdlib>  // std::size_t, std::malloc, std::free
+#include <cstddef>  // std::ptrdiff_t
+
+#include <algorithm>  // std::swap
+#include <limits>
+#include <new>  // std::bad_alloc, placement new
+#include <vector>
+
+#include "knapsack/nullptr.h"
+
+// A monotonic arena: Memory is taken from large blocks by incrementing
+// a pointer, and it is only freed when the whole arena is released.
+// Alternatively, the arena can be reset so that the blocks are reused.
+// Copying an arena gives a new empty arena.
+
+class KnapsackArena {
+ public:
+  KnapsackArena()
+    : current_(0), offset_(0), next_size_(kMinBlock) {
+  }
+
+  KnapsackArena(const KnapsackArena& /* arena */)
+    : current_(0), offset_(0), next_size_(kMinBlock) {
+  }
+
+  KnapsackArena& operator=(const KnapsackArena& /* arena */) {
+    return *this;
+  }
+
+  ~KnapsackArena() {
+    Release();
+  }
+
+  void *Allocate(std::size_t bytes) {
+    bytes = (bytes + (kAlign - 1)) & ~(kAlign - 1);
+    for (; current_ != block_.size(); ++current_, offset_ = 0) {
+      Block& block = block_[current_];
+      if (block.size_ - offset_ >= bytes) {
+        void *result(block.data_ + offset_);
+        offset_ += bytes;
+        return result;
+      }
+    }
+    std::size_t size(next_size_);
+    if (next_size_ < kMaxBlock) {
+      next_size_ *= 2;
+    }
+    if (size < bytes) {
+      size = bytes;
+    }
+    Block block;
+    block.data_ = static_cast<char *>(std::malloc(size));
+    if (block.data_ == KNAPSACK_NULLPTR) {
+      throw std::bad_alloc();
+    }
+    block.size_ = size;
+    block_.push_back(block);
+    offset_ = bytes;
+    return block.data_;
+  }
+
+  // Free all memory
+  void Release() {
+    for (BlockList::iterator it(block_.begin()); it != block_.end(); ++it) {
+      std::free(it->data_);
+    }
+    BlockList().swap(block_);
+    current_ = offset_ = 0;
+    next_size_ = kMinBlock;
+  }
+
+  // Keep the memory for reuse
+  void Reset() {
+    current_ = offset_ = 0;
+  }
+
+  // Exchange the memory with that of another arena
+  void swap(KnapsackArena& arena) {
+    block_.swap(arena.block_);
+    std::swap(current_, arena.current_);
+    std::swap(offset_, arena.offset_);
+    std::swap(next_size_, arena.next_size_);
+  }
+
+  // The number of bytes allocated from the system
+  std::size_t bytes() const {
+    std::size_t result(0);
+    for (BlockList::const_iterator it(block_.begin()); it != block_.end();
+      ++it) {
+      result += it->size_;
+    }
+    return result;
+  }
+
+ private:
+  static const std::size_t kAlign = 16;
+  static const std::size_t kMinBlock = (std::size_t(1) << 16);
+  static const std::size_t kMaxBlock = (std::size_t(1) << 24);
+
+  class Block {
+   public:
+    char *data_;
+    std::size_t size_;
+  };
+  typedef std::vector<Block> BlockList;
+
+  BlockList block_;
+  BlockList::size_type current_;
+  std::size_t offset_, next_size_;
+};
+
+// The allocators which can be used as the Allocator parameter of Knapsack.
+// They are constructed from a pointer to the arena of the Knapsack object.
+// The types used with them need not be destructed.
+// construct() and destroy() are only defined before C++11; later, they are
+// supplied by std::allocator_traits.
+
+// An allocator which takes the memory from the arena; deallocate() is a noop
+template <class T>
+class KnapsackArenaAllocator {
+ public:
+  typedef T value_type;
+  typedef T *pointer;
+  typedef const T *const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef std::size_t size_type;
+  typedef std::ptrdiff_t difference_type;
+
+  template <class U>
+  class rebind {
+   public:
+    typedef KnapsackArenaAllocator<U> other;
+  };
+
+  explicit KnapsackArenaAllocator(KnapsackArena *arena)
+    : arena_(arena) {
+  }
+
+  template <class U>
+  KnapsackArenaAllocator(const KnapsackArenaAllocator<U>& a)  // NOLINT
+    : arena_(a.get_arena()) {
+  }
+
+  KnapsackArena *get_arena() const {
+    return arena_;
+  }
+
+  pointer allocate(size_type n,
+      const void * /* hint */ = KNAPSACK_NULLPTR) {
+    return static_cast<pointer>(arena_->Allocate(n * sizeof(T)));
+  }
+
+  void deallocate(pointer /* p */, size_type /* n */) throw() {
+  }
+
+  size_type max_size() const {
+    return std::numeric_limits<size_type>::max() / sizeof(T);
+  }
+
+#if __cplusplus < 201103L
+  void construct(pointer p, const T& value) {
+    new(p) T(value);
+  }
+
+  void destroy(pointer p) throw() {
+    p->~T();
+  }
+#endif
+
+  pointer address(reference r) const {
+    return &r;
+  }
+
+  const_pointer address(const_reference r) const {
+    return &r;
+  }
+
+  template <class U>
+  bool operator==(const KnapsackArenaAllocator<U>& a) const {
+    return (arena_ == a.get_arena());
+  }
+
+  template <class U>
+  bool operator!=(const KnapsackArenaAllocator<U>& a) const {
+    return (arena_ != a.get_arena());
+  }
+
+ private:
+  KnapsackArena *arena_;
+};
+
+// An allocator which ignores the arena and uses the heap
+template <class T>
+class KnapsackHeapAllocator {
+ public:
+  typedef T value_type;
+  typedef T *pointer;
+  typedef const T *const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef std::size_t size_type;
+  typedef std::ptrdiff_t difference_type;
+
+  template <class U>
+  class rebind {
+   public:
+    typedef KnapsackHeapAllocator<U> other;
+  };
+
+  explicit KnapsackHeapAllocator(
+      KnapsackArena * /* arena */ = KNAPSACK_NULLPTR) {
+  }
+
+  template <class U>
+  KnapsackHeapAllocator(const KnapsackHeapAllocator<U>& /* a */) {  // NOLINT
+  }
+
+  pointer allocate(size_type n,
+      const void * /* hint */ = KNAPSACK_NULLPTR) {
+    return static_cast<pointer>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(pointer p, size_type /* n */) throw() {
+    ::operator delete(p);
+  }
+
+  size_type max_size() const {
+    return std::numeric_limits<size_type>::max() / sizeof(T);
+  }
+
+#if __cplusplus < 201103L
+  void construct(pointer p, const T& value) {
+    new(p) T(value);
+  }
+
+  void destroy(pointer p) throw() {
+    p->~T();
+  }
+#endif
+
+  pointer address(reference r) const {
+    return &r;
+  }
+
+  const_pointer address(const_reference r) const {
+    return &r;
+  }
+
+  template <class U>
+  bool operator==(const KnapsackHeapAllocator<U>& /* a */) const {
+    return true;
+  }
+
+  template <class U>
+  bool operator!=(const KnapsackHeapAllocator<U>& /* a */) const {
+    return false;
+  }
+};
+
+#endif  // KNAPSACK_ARENA_H_
@@ -0,0 +1,86 @@
+// This file is part of the knapsack project and distributed under the
+// terms of the GNU General Public License v2.
+// SPDX-License-Identifier: GPL-2.0-only
+//
+// Copyright (c)
+//   Martin Väth <martin@mvath.de>
+
+#ifndef KNAPSACK_DEADLINE_H_
+#define KNAPSACK_DEADLINE_H_ 1
+
+#include <exception>
+
+#if __cplusplus >= 201103L
+#include <chrono>
+#else
+#include <ctime>  // std::time, std::difftime
+#endif
+
+#include "knapsack/nullptr.h"
+
+// A function which is called regularly during a calculation; if it returns
+// true, the calculation is cancelled. data is passed unchanged.
+typedef bool (*KnapsackCancel)(void *data);
+
+// Thrown when a calculation is cancelled (see KnapsackDeadline::Check())
+class KnapsackInterrupted : public std::exception {
+ public:
+  virtual const char *what() const throw() {
+    return "knapsack calculation interrupted";
+  }
+};
+
+// The limit of a calculation: A time limit in seconds (negative means no
+// limit), measured from the construction, and optionally a KnapsackCancel
+// function. Reached() is const and may be called from several threads
+// at once (then also the KnapsackCancel function is called concurrently).
+// Without C++11, the clock has a resolution of only one second.
+
+class KnapsackDeadline {
+ public:
+  KnapsackDeadline(double seconds, KnapsackCancel cancel, void *data)
+    : seconds_(seconds), cancel_(cancel), data_(data),
+#if __cplusplus >= 201103L
+    start_(std::chrono::steady_clock::now()) {
+#else
+    start_(std::time(KNAPSACK_NULLPTR)) {
+#endif
+  }
+
+  // Whether the time limit is exceeded or the calculation is cancelled
+  bool Reached() const {
+    if ((cancel_ != KNAPSACK_NULLPTR) && (*cancel_)(data_)) {
+      return true;
+    }
+    return ((seconds_ >= 0) && !(Elapsed() < seconds_));
+  }
+
+  // Throw KnapsackInterrupted if Reached()
+  void Check() const {
+    if (Reached()) {
+      throw KnapsackInterrupted();
+    }
+  }
+
+  // The seconds since the construction
+  double Elapsed() const {
+#if __cplusplus >= 201103L
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+      start_).count();
+#else
+    return std::difftime(std::time(KNAPSACK_NULLPTR), start_);
+#endif
+  }
+
+ private:
+  double seconds_;
+  KnapsackCancel cancel_;
+  void *data_;
+#if __cplusplus >= 201103L
+  std::chrono::steady_clock::time_point start_;
+#else
+  std::time_t start_;
+#endif
+};
+
+#endif  // KNAPSACK_DEADLINE_H_
@@ -0,0 +1,239 @@
+// This file is part of the knapsack project and distributed under the
+// terms of the GNU General Public License v2.
+// SPDX-License-Identifier: GPL-2.0-only
+//
+// Copyright (c)
+//   Martin Väth <martin@mvath.de>
+
+#ifndef KNAPSACK_DENSE_H_
+#define KNAPSACK_DENSE_H_ 1
+
+#include <boost/cstdint.hpp>  // boost::uint64_t
+
+#include <algorithm>  // std::copy
+#include <cstdlib>  // std::size_t
+
+#include <vector>
+
+// The dense engine for one or two knapsacks with small capacities:
+// The values of all states are kept in arrays.
+// A state consists of the residual capacities r_first, r_last of the
+// knapsacks (first is the knapsack with index 0, last the one with the
+// highest index; for one knapsack, r_first is always 0); it is stored at
+// the index r_first * width + r_last, where width is the capacity of the
+// last knapsack plus 1.
+//
+// The recursion and the resolution of ties are the same as for the hash
+// engine of Knapsack so that the same solution is found:
+// For a bound item which is available count times, the value when placing
+// it is compared with the value when skipping it completely (i.e. the value
+// of the next bound item); a strictly larger value is selected.
+// The last knapsack is tried first, and the first knapsack is tried only if
+// its residual capacity differs from that of the last knapsack.
+// For bound items, the decisions are stored as bits in a layer for each
+// count; the bound items must be added in reverse order.
+// Then the unbound items are added (in the order in which they are tried);
+// their decisions are calculated again when they are needed.
+
+template <class Value, class Allocator>
+class KnapsackDense {
+ public:
+  typedef Value value_type;
+  typedef std::size_t size_type;
+
+  enum Decision {
+    kSkip,
+    kFirst,
+    kLast
+  };
+
+  KnapsackDense(size_type rows, size_type width, const Allocator& allocator)
+    : rows_(rows), width_(width), cells_(rows * width),
+    words_((cells_ + kWordBits - 1) / kWordBits),
+    layer_words_((rows > 1) ? (2 * words_) : words_),
+    base_(cells_, value_type(0), ValueAllocator(allocator)),
+    prev_(cells_, value_type(0), ValueAllocator(allocator)),
+    current_(cells_, value_type(0), ValueAllocator(allocator)),
+    bits_(WordAllocator(allocator)), layers_(0), unbound_(false),
+    unbound_weight_(SizeAllocator(allocator)),
+    unbound_value_(ValueAllocator(allocator)) {
+  }
+
+  // The approximate number of bytes needed for the given number of layers
+  static long double Bytes(size_type rows, size_type width,
+      size_type layers) {
+    long double cells(static_cast<long double>(rows) *
+      static_cast<long double>(width));
+    return (cells * 3 * sizeof(value_type) +
+      cells * static_cast<long double>(layers) * ((rows > 1) ? 2 : 1) / 8);
+  }
+
+  size_type Cell(size_type first, size_type last) const {
+    return first * width_ + last;
+  }
+
+  value_type get_value(size_type cell) const {
+    return base_[cell];
+  }
+
+  // Add a bound item which can be used count times (count must be positive).
+  // Returns the index of the first layer: The decisions of the state with
+  // count c (1 <= c <= count) are in the layer with index result + c - 1.
+  size_type AddBound(size_type weight, value_type value, size_type count) {
+    size_type result(layers_);
+    layers_ += count;
+    bits_.resize(layers_ * layer_words_, boost::uint64_t(0));
+    std::copy(base_.begin(), base_.end(), prev_.begin());
+    for (size_type layer(result); layer != layers_; ++layer) {
+      boost::uint64_t *take(&bits_[layer * layer_words_]);
+      for (size_type row(0); row != rows_; ++row) {
+        Layer(row, weight, value, take);
+      }
+      prev_.swap(current_);
+    }
+    base_.swap(prev_);
+    return result;
+  }
+
+  // Add the unbound items after all bound items; the arrays are copied.
+  // This can be done only once.
+  void AddUnbound(const size_type *weight, const value_type *value,
+      size_type count) {
+    unbound_weight_.assign(weight, weight + count);
+    unbound_value_.assign(value, value + count);
+    std::copy(base_.begin(), base_.end(), prev_.begin());
+    unbound_ = true;
+    size_type cell(0);
+    for (size_type row(0); row != rows_; ++row) {
+      for (size_type last(0); last != width_; ++last, ++cell) {
+        Decision decision;
+        value_type best(base_[cell]);
+        DecideUnbound(row, last, &decision, &best);
+        base_[cell] = best;
+      }
+    }
+  }
+
+  // The decision for the bound item of the given layer
+  Decision DecideBound(size_type layer, size_type cell) const {
+    const boost::uint64_t *take(&bits_[layer * layer_words_]);
+    size_type word(cell / kWordBits);
+    boost::uint64_t bit(boost::uint64_t(1) << (cell % kWordBits));
+    if ((take[word] & bit) == 0) {
+      return kSkip;
+    }
+    if ((rows_ > 1) && ((take[words_ + word] & bit) != 0)) {
+      return kFirst;
+    }
+    return kLast;
+  }
+
+  // The index (in the order of AddUnbound()) of the unbound item which is
+  // placed in the state with the residual capacities first and last.
+  // If none is placed, the number of unbound items is returned.
+  size_type DecideUnbound(size_type first, size_type last,
+      Decision *decision) const {
+    // Start with the value without unbound items
+    value_type best(unbound_ ? prev_[Cell(first, last)] : base_[Cell(first,
+      last)]);
+    return DecideUnbound(first, last, decision, &best);
+  }
+
+ private:
+  typedef typename Allocator::template rebind<value_type>::other
+    ValueAllocator;
+  typedef typename Allocator::template rebind<boost::uint64_t>::other
+    WordAllocator;
+  typedef typename Allocator::template rebind<size_type>::other
+    SizeAllocator;
+  typedef std::vector<value_type, ValueAllocator> ValueList;
+  typedef std::vector<boost::uint64_t, WordAllocator> WordList;
+  typedef std::vector<size_type, SizeAllocator> SizeList;
+
+  static const size_type kWordBits = 64;
+
+  size_type rows_, width_, cells_, words_, layer_words_;
+
+  // base_ contains the values of the states with the items added so far,
+  // prev_ and current_ are used for the calculation of the layers.
+  // After AddUnbound(), prev_ contains the values without unbound items.
+  ValueList base_, prev_, current_;
+  WordList bits_;
+  size_type layers_;
+  bool unbound_;
+  SizeList unbound_weight_;
+  ValueList unbound_value_;
+
+  // Calculate row of current_ from prev_ (the layer with one count less)
+  // and base_ (the values when the item is skipped).
+  // The inner loops have no dependencies so that they can be vectorized.
+  void Layer(size_type row, size_type weight, value_type value,
+      boost::uint64_t *take) {
+    size_type offset(row * width_);
+    const value_type *skip(&base_[offset]);
+    const value_type *prev(&prev_[offset]);
+    value_type *current(&current_[offset]);
+    size_type end((weight < width_) ? weight : width_);
+    for (size_type last(0); last != end; ++last) {
+      current[last] = skip[last];
+    }
+    for (size_type last(weight); last < width_; ++last) {
+      value_type placed(prev[last - weight] + value);
+      current[last] = ((placed > skip[last]) ? placed : skip[last]);
+    }
+    boost::uint64_t *first_bits(take + words_);
+    if ((rows_ > 1) && (row >= weight)) {
+      const value_type *prev_first(&prev_[offset - weight * width_]);
+      for (size_type last(0); last != width_; ++last) {
+        value_type placed(prev_first[last] + value);
+        if ((placed > current[last]) && (last != row)) {
+          current[last] = placed;
+          size_type cell(offset + last);
+          first_bits[cell / kWordBits] |=
+            (boost::uint64_t(1) << (cell % kWordBits));
+        }
+      }
+    }
+    for (size_type last(0); last != width_; ++last) {
+      if (current[last] > skip[last]) {
+        size_type cell(offset + last);
+        take[cell / kWordBits] |= (boost::uint64_t(1) << (cell % kWordBits));
+      }
+    }
+  }
+
+  // Try all unbound items (starting with the value *best) and store the
+  // value and decision. Returns the item (or the number of items)
+  size_type DecideUnbound(size_type first, size_type last,
+      Decision *decision, value_type *best) const {
+    size_type count(unbound_weight_.size()), result(count);
+    *decision = kSkip;
+    for (size_type i(0); i != count; ++i) {
+      size_type weight(unbound_weight_[i]);
+      value_type value(unbound_value_[i]);
+      if (weight <= last) {
+        value_type placed(base_[Cell(first, last - weight)] + value);
+        if (placed > *best) {
+          *best = placed;
+          *decision = kLast;
+          result = i;
+        }
+      }
+      if ((rows_ > 1) && (weight <= first) && (first != last)) {
+        value_type placed(base_[Cell(first - weight, last)] + value);
+        if (placed > *best) {
+          *best = placed;
+          *decision = kFirst;
+          result = i;
+        }
+      }
+    }
+    return result;
+  }
+
+  // This class is not meant to be copied
+  KnapsackDense(const KnapsackDense&);
+  KnapsackDense& operator=(const KnapsackDense&);
+};
+
+#endif  // KNAPSACK_DENSE_H_
@@ -6,18 +6,28 @@
 //   Martin Väth <martin@mvath.de>
 
 #include "knapsack/knapsack.h"
+#include "knapsack/nullptr.h"
 
 #include <boost/program_options.hpp>  // boost::program_options
 #include <boost/algorithm/string.hpp>  // boost::split, boost::is_any_of
 #include <boost/format.hpp>  // boost::format
 #include <boost/lexical_cast.hpp>  // boost::lexical_cast
 
-#include <unistd.h>  // getopt
+#include <signal.h>  // sigaction
+#include <sys/time.h>  // setitimer
+#include <unistd.h>  // getopt, sysconf
 
-#include <cstdlib>  // exit
-#include <cstdio>  // puts, fputs, stderr, stdout
+#include <csignal>  // std::sig_atomic_t
+#include <cstdlib>  // exit, std::size_t, std::free, std::strtold
+#include <cstdio>  // puts, fputs, fflush, stderr, stdin, stdout, std::fopen
+#include <cstring>  // std::strchr
 
 #include <exception>
+#include <fstream>
+#include <iostream>  // std::cin
+#include <limits>
+#include <map>
+#include <stdexcept>  // std::runtime_error
 #include <string>
 #include <vector>
 
@@ -33,7 +43,7 @@ typedef unsigned long Integer;  // NOLINT(runtime/int)
 #endif
 typedef long double Float;
 
-static const char *version = "knapsack 7.3";
+static const char *version = "knapsack 8.0";
 
 using std::string;
 using std::vector;
@@ -44,12 +54,93 @@ typedef Knapsack<Integer, Float, Integer> KnapsackFloat;
 
 typedef vector<string> WordList;
 
+// An invalid number or instance: On the command line, this is fatal;
+// in batch mode, only the instance fails.
+class ParseError : public std::runtime_error {
+ public:
+  explicit ParseError(const string& s)
+    : std::runtime_error(s) {
+  }
+};
+
+// The result of CheckItem()
+enum ItemCheck {
+  kItemFits,
+  kItemUnbound,  // the count was set to 0
+  kItemTooHeavy
+};
+
+// The options which are not stored in the Knapsack object
+class Settings {
+ public:
+  bool quiet_, value_only_, float_, force_;
+  string batch_;  // the file name for batch mode (- is stdin)
+  string sacks_from_, items_from_;  // files of knapsacks/items (- is stdin)
+  unsigned int jobs_;
+  bool incremental_;  // use a Knapsack::Session in batch mode
+  bool stats_;
+  double progress_;  // the interval of progress reports (0 means none)
+
+  Settings()
+    : quiet_(false), value_only_(false), float_(false), force_(false),
+    jobs_(1), incremental_(false), stats_(false), progress_(0) {
+  }
+};
+
+// Set by the handlers of SIGUSR1 and SIGALRM (see InstallProgress())
+static volatile std::sig_atomic_t progress_request(0);
+
+// The data of ReportProgress() for one Knapsack object
+class Progress {
+ public:
+  bool float_;
+  string where_;  // the prefix of the output
+  double seconds_;  // of the previous report
+  std::size_t states_;  // of the previous report
+
+  explicit Progress(bool is_float)
+    : float_(is_float), seconds_(0), states_(0) {
+  }
+
+  // Start a new calculation
+  void Restart(const string& where) {
+    where_ = where;
+    seconds_ = 0;
+    states_ = 0;
+  }
+};
+
 static void Help(const boost::program_options::options_description& options);
 template<class T> void Warn(T s);
 template<class T> ATTRIBUTE_NORETURN void Die(T s);
 template<class T> T ParseNumber(const string& s, bool check_positive = true);
 static Integer CountMax(const KnapsackCommon& sack, Integer weight);
-KnapsackCommon *opt_parse(int argc, char *argv[]);
+static std::size_t ParseSize(const string& s);
+static ItemCheck CheckItem(const KnapsackCommon& knapsack,
+  const Settings& settings, Integer weight, Integer *count);
+static void WarnItem(ItemCheck check, const Settings& settings,
+  const string& where, const string& item);
+static bool IsSpace(char c);
+static bool ScanInteger(const char **pos, const char *end, Integer *result);
+static void ReadSacks(const string& name, KnapsackCommon *knapsack);
+static void ReadItems(const string& name, const Settings& settings,
+  KnapsackCommon *knapsack);
+static void ParseInstance(const WordList& opt_sack, const WordList& opt_item,
+  const Settings& settings, const string& where, KnapsackCommon *knapsack);
+static void ParseLine(const string& line, WordList *sack, WordList *item);
+static void SolveInstance(const KnapsackCommon& knapsack,
+  const Settings& settings, const string& where, string *result);
+static void ReportSolved(const KnapsackCommon& knapsack,
+  const Settings& settings, const string& where);
+extern "C" void RequestProgress(int signal);
+static void InstallProgress(const Settings& settings);
+static std::size_t ResidentBytes();
+static string FormatProgressValue(const Progress& progress,
+  long double value);
+static void ReportProgress(const KnapsackProgressInfo& info, void *data);
+KnapsackCommon *opt_parse(int argc, char *argv[], Settings *settings);
+static int RunBatch(const KnapsackCommon& prototype,
+  const Settings& settings);
 
 static void Help(const boost::program_options::options_description& options) {
   std::puts((boost::format("Usage: knapsack [options] [item item ...]\n"
@@ -72,6 +163,8 @@ static void Help(const boost::program_options::options_description& options) {
 "\n"
 "knapsacks can be specified with option -s, items with option -i or also\n"
 "simply as arguments on the command line (see option -i below for details.)\n"
+"Many knapsacks or items can be read from files with options --sacks-from\n"
+"and --items-from.\n"
 "If there is no item which can be put into a knapsack, the program exits\n"
 "with nonzero error status and an error message; otherwise the program prints\n"
 "a solution with maximal value and returns with zero error status, unless it\n"
@@ -94,10 +187,11 @@ template<class T> T ParseNumber(const string& s, bool check_positive) {
   try {
     result = boost::lexical_cast<T>(s);
   } catch (const boost::bad_lexical_cast& e) {
-    Die(boost::format("number %s: %s") % s % e.what());
+    throw ParseError((boost::format("number %s: %s") % s % e.what()).str());
   }
   if (check_positive && (result <= 0)) {
-    Die(boost::format("number %s: not a positive number") % s);
+    throw ParseError((boost::format("number %s: not a positive number")
+      % s).str());
   }
   return result;
 }
@@ -112,10 +206,500 @@ static Integer CountMax(const KnapsackCommon& sack, Integer weight) {
   return count_max;
 }
 
-KnapsackCommon *opt_parse(int argc, char *argv[]) {
+// A number of bytes with an optional suffix K, M, or G
+static std::size_t ParseSize(const string& s) {
+  string::size_type len(s.size());
+  std::size_t factor(1);
+  if (len != 0) {
+    switch (s[len - 1]) {
+      case 'k':
+      case 'K':
+        factor = (std::size_t(1) << 10);
+        break;
+      case 'm':
+      case 'M':
+        factor = (std::size_t(1) << 20);
+        break;
+      case 'g':
+      case 'G':
+        factor = (std::size_t(1) << 30);
+        break;
+      default:
+        break;
+    }
+  }
+  if (factor != 1) {
+    --len;
+  }
+  std::size_t result(ParseNumber<std::size_t>(s.substr(0, len), false));
+  if (result > static_cast<std::size_t>(-1) / factor) {
+    throw ParseError((boost::format("size %s: too large") % s).str());
+  }
+  return result * factor;
+}
+
+// Unless settings.force_, check whether an item with the given weight fits
+// into a knapsack and whether the knapsacks cannot carry more than *count
+// copies of it; in the latter case, *count is set to 0 (unbound)
+static ItemCheck CheckItem(const KnapsackCommon& knapsack,
+    const Settings& settings, Integer weight, Integer *count) {
+  if (settings.force_) {
+    return kItemFits;
+  }
+  Integer count_max(CountMax(knapsack, weight));
+  if (count_max <= 0) {
+    return kItemTooHeavy;
+  }
+  if (*count >= count_max) {
+    *count = 0;
+    return kItemUnbound;
+  }
+  return kItemFits;
+}
+
+// The warning about the result of CheckItem(); where is its prefix
+static void WarnItem(ItemCheck check, const Settings& settings,
+    const string& where, const string& item) {
+  if (settings.quiet_) {
+    return;
+  }
+  switch (check) {
+    case kItemTooHeavy:
+      Warn(boost::format("%signoring too heavy item %s") % where % item);
+      break;
+    case kItemUnbound:
+      Warn(boost::format("%streating item %s as unbound (N=0) "
+        "for efficiency") % where % item);
+      break;
+    case kItemFits:
+    default:
+      break;
+  }
+}
+
+// Read a file (- is stdin) line by line into one buffer which is reused
+class LineReader {
+ public:
+  explicit LineReader(const string& name)
+    : name_(name), buffer_(KNAPSACK_NULLPTR), capacity_(0), line_(0) {
+    file_ = ((name == "-") ? stdin : std::fopen(name.c_str(), "r"));
+    if (file_ == KNAPSACK_NULLPTR) {
+      throw ParseError((boost::format("cannot open %s") % name).str());
+    }
+  }
+
+  ~LineReader() {
+    std::free(buffer_);
+    if (file_ != stdin) {
+      std::fclose(file_);
+    }
+  }
+
+  // Read the next line which is not empty and not a comment (starting
+  // with #); [*begin, *end) is the line without surrounding whitespace.
+  // Returns false at the end of the file.
+  bool Next(const char **begin, const char **end) {
+    for (;;) {
+      ssize_t length(::getline(&buffer_, &capacity_, file_));
+      if (length < 0) {
+        if (std::ferror(file_)) {
+          throw ParseError((boost::format("cannot read %s") % name_).str());
+        }
+        return false;
+      }
+      ++line_;
+      const char *first(buffer_), *last(buffer_ + length);
+      while ((first != last) && IsSpace(*first)) {
+        ++first;
+      }
+      while ((first != last) && IsSpace(*(last - 1))) {
+        --last;
+      }
+      if ((first != last) && (*first != '#')) {
+        *begin = first;
+        *end = last;
+        return true;
+      }
+    }
+  }
+
+  // The prefix of messages about the current line
+  string Where() const {
+    return (boost::format("%s:%s: ") % name_ % line_).str();
+  }
+
+ private:
+  string name_;
+  std::FILE *file_;
+  char *buffer_;
+  std::size_t capacity_;
+  std::size_t line_;
+
+  // This class is not meant to be copied
+  LineReader(const LineReader&);
+  LineReader& operator=(const LineReader&);
+};
+
+static bool IsSpace(char c) {
+  return ((c == ' ') || (c == '\t') || (c == '\r') || (c == '\n'));
+}
+
+// Parse the decimal digits at *pos (before end) and advance *pos behind
+// them; return false if there is no digit or the number is too large
+static bool ScanInteger(const char **pos, const char *end, Integer *result) {
+  const char *p(*pos);
+  Integer number(0);
+  for (; (p != end) && (*p >= '0') && (*p <= '9'); ++p) {
+    Integer digit(static_cast<Integer>(*p - '0'));
+    if (number > (std::numeric_limits<Integer>::max() - digit) / 10) {
+      return false;
+    }
+    number = number * 10 + digit;
+  }
+  if (p == *pos) {
+    return false;
+  }
+  *pos = p;
+  *result = number;
+  return true;
+}
+
+// Append the knapsacks of file name: [N*]capacity separated by whitespace
+static void ReadSacks(const string& name, KnapsackCommon *knapsack) {
+  KnapsackCommon::WeightList& sack = knapsack->knapsack_;
+  LineReader reader(name);
+  const char *p, *end;
+  while (reader.Next(&p, &end)) {
+    while (p != end) {
+      const char *word(p);
+      Integer count(1), capacity;
+      bool valid(ScanInteger(&p, end, &capacity));
+      if (valid && (p != end) && !IsSpace(*p)) {
+        count = capacity;
+        valid = ((std::strchr(":*xX", *p) != KNAPSACK_NULLPTR) &&
+          ScanInteger(&++p, end, &capacity));
+      }
+      if (!valid || (count == 0) || (capacity == 0) ||
+        ((p != end) && !IsSpace(*p))) {
+        while ((p != end) && !IsSpace(*p)) {
+          ++p;
+        }
+        throw ParseError((boost::format("%sinvalid knapsack %s") %
+          reader.Where() % string(word, p)).str());
+      }
+      sack.insert(sack.end(), count, capacity);
+      while ((p != end) && IsSpace(*p)) {
+        ++p;
+      }
+    }
+  }
+}
+
+// Append the items of file name, one per line: [N*]weight[=value],
+// optionally followed by whitespace and a label (the rest of the line)
+static void ReadItems(const string& name, const Settings& settings,
+    KnapsackCommon *knapsack) {
+  LineReader reader(name);
+  const char *p, *end;
+  while (reader.Next(&p, &end)) {
+    const char *item(p), *item_end(p);
+    while ((item_end != end) && !IsSpace(*item_end)) {
+      ++item_end;
+    }
+    Integer count(1), weight, value(0);
+    Float float_value(0);
+    bool valid(ScanInteger(&p, item_end, &weight));
+    if (valid && (p != item_end) &&
+      (std::strchr(":*xX", *p) != KNAPSACK_NULLPTR)) {
+      count = weight;
+      valid = ScanInteger(&++p, item_end, &weight);
+    }
+    valid = (valid && (weight != 0));
+    if (valid && (p != item_end) &&
+      (std::strchr("=~#@", *p) != KNAPSACK_NULLPTR)) {
+      if (settings.float_) {
+        // The item is followed by whitespace or by the 0 of getline()
+        char *value_end;
+        float_value = std::strtold(++p, &value_end);
+        valid = (float_value > 0);
+        p = value_end;
+      } else {
+        valid = (ScanInteger(&++p, item_end, &value) && (value != 0));
+      }
+    }
+    if (!valid || (p != item_end)) {
+      throw ParseError((boost::format("%sinvalid item %s") % reader.Where() %
+        string(item, item_end)).str());
+    }
+    ItemCheck check(CheckItem(*knapsack, settings, weight, &count));
+    if (check != kItemFits) {
+      WarnItem(check, settings, reader.Where(), string(item, item_end));
+      if (check == kItemTooHeavy) {
+        continue;
+      }
+    }
+    knapsack->count_.push_back(count);
+    knapsack->weight_.push_back(weight);
+    if (settings.float_) {
+      static_cast<KnapsackFloat *>(knapsack)->value_.push_back(float_value);
+    } else {
+      static_cast<KnapsackInt *>(knapsack)->value_.push_back(value);
+    }
+    p = item_end;
+    while ((p != end) && IsSpace(*p)) {
+      ++p;
+    }
+    if (p != end) {
+      KnapsackCommon::LabelList& label = knapsack->label_;
+      label.resize(knapsack->size());
+      label.back().assign(p, end);
+    }
+  }
+}
+
+// Store the knapsacks and items in knapsack; where is the prefix of warnings
+static void ParseInstance(const WordList& opt_sack, const WordList& opt_item,
+    const Settings& settings, const string& where,
+    KnapsackCommon *knapsack) {
+  KnapsackCommon::WeightList& sack = knapsack->knapsack_;
+  for (WordList::const_iterator it(opt_sack.begin()); it != opt_sack.end();
+    ++it) {
+    WordList parts;
+    boost::split(parts, *it, boost::is_any_of(":*xX"));
+    if (parts.size() <= 1) {
+      sack.push_back(ParseNumber<Integer>(parts[0]));
+    } else {
+      sack.insert(sack.end(), ParseNumber<Integer>(parts[0]),
+        ParseNumber<Integer>(parts[1]));
+    }
+  }
+  if (!settings.sacks_from_.empty()) {
+    ReadSacks(settings.sacks_from_, knapsack);
+  }
+  if (knapsack->sack_empty()) {
+    throw ParseError(
+      "at least one knapsack must be specified, e.g. with option -s");
+  }
+  for (WordList::const_iterator it(opt_item.begin()); it != opt_item.end();
+    ++it) {
+    WordList parts;
+    boost::split(parts, *it, boost::is_any_of(":*xX \t\r\n"));
+    string rest;
+    Integer count;
+    if (parts.size() <= 1) {
+      rest = parts[0];
+      count = 1;
+    } else {
+      rest = parts[1];
+      count = ParseNumber<Integer>(parts[0], false);
+    }
+    boost::split(parts, rest, boost::is_any_of("=~#@"));
+    Integer weight(ParseNumber<Integer>(parts[0]));
+    ItemCheck check(CheckItem(*knapsack, settings, weight, &count));
+    WarnItem(check, settings, where, *it);
+    if (check == kItemTooHeavy) {
+      continue;
+    }
+    knapsack->count_.push_back(count);
+    knapsack->weight_.push_back(weight);
+    if (parts.size() <= 1) {
+      if (settings.float_) {
+        static_cast<KnapsackFloat *>(knapsack)->value_.push_back(0);
+      } else {
+        static_cast<KnapsackInt *>(knapsack)->value_.push_back(0);
+      }
+    } else {
+      if (settings.float_) {
+        static_cast<KnapsackFloat *>(knapsack)->value_.push_back(
+          ParseNumber<Float>(parts[1]));
+      } else {
+        static_cast<KnapsackInt *>(knapsack)->value_.push_back(
+          ParseNumber<Integer>(parts[1]));
+      }
+    }
+  }
+  if (!settings.items_from_.empty()) {
+    ReadItems(settings.items_from_, settings, knapsack);
+  }
+  if (knapsack->empty()) {
+    throw ParseError("at least one not too heavy item must be specified");
+  }
+}
+
+// Split an instance of batch mode into the arguments of the options -s
+// (also as -sN, --sack N, or --sack=N) and the items (with or without -i)
+static void ParseLine(const string& line, WordList *sack, WordList *item) {
+  WordList words;
+  boost::split(words, line, boost::is_any_of(" \t\r\n"),
+    boost::token_compress_on);
+  for (WordList::size_type i(0); i != words.size(); ++i) {
+    const string& word = words[i];
+    if (word.empty()) {
+      continue;
+    }
+    WordList *list(item);
+    string option, arg(word);
+    if (word.compare(0, 2, "--") == 0) {
+      string::size_type equal(word.find('='));
+      if (equal == string::npos) {
+        option = word.substr(2);
+        arg.clear();
+      } else {
+        option = word.substr(2, equal - 2);
+        arg = word.substr(equal + 1);
+      }
+    } else if (word[0] == '-') {
+      option = word.substr(1, 1);
+      arg = word.substr(2);
+    }
+    if (!option.empty()) {
+      if ((option == "s") || (option == "sack")) {
+        list = sack;
+      } else if ((option != "i") && (option != "item")) {
+        throw ParseError((boost::format("unknown option %s") % word).str());
+      }
+      if (arg.empty()) {
+        if (++i == words.size()) {
+          throw ParseError((boost::format("option %s needs an argument")
+            % word).str());
+        }
+        arg = words[i];
+      }
+    }
+    list->push_back(arg);
+  }
+}
+
+// Solve and append the output to *result; where is the prefix of warnings
+static void SolveInstance(const KnapsackCommon& knapsack,
+    const Settings& settings, const string& where, string *result) {
+  if (settings.value_only_) {
+    knapsack.SolveValueAppend(result);
+  } else {
+    knapsack.SolveAppend(result);
+  }
+  ReportSolved(knapsack, settings, where);
+}
+
+// Print the statistics and warnings about the last Solve(); where is
+// their prefix
+static void ReportSolved(const KnapsackCommon& knapsack,
+    const Settings& settings, const string& where) {
+  if (settings.stats_) {
+    string stats;
+    knapsack.get_stats().Append(&stats);
+    fputs((boost::format("knapsack: %sstats: %s\n") % where % stats).str()
+      .c_str(), stderr);
+  }
+  if (settings.quiet_) {
+    return;
+  }
+  if (knapsack.evicted() != 0) {
+    Warn(boost::format("%smemory limit reached: %s states were forgotten")
+      % where % knapsack.evicted());
+  }
+  if (knapsack.memory_exceeded()) {
+    Warn(boost::format("%smemory limit exceeded: forgetting states did not "
+      "free enough") % where);
+  }
+  if (knapsack.memo_failed()) {
+    Warn(boost::format("%scannot write the file in the memo directory %s")
+      % where % knapsack.get_memo_dir());
+  }
+  if (!knapsack.IsOptimal()) {
+    string bound;
+    knapsack.UpperBoundAppend(&bound);
+    Warn(boost::format("%sthe result might not be optimal; "
+      "the maximal value is at most %s") % where % bound);
+  }
+}
+
+extern "C" void RequestProgress(int /* signal */) {
+  progress_request = 1;
+}
+
+// Request progress reports on SIGUSR1 and, if settings.progress_ is
+// positive, with this interval by SIGALRM
+static void InstallProgress(const Settings& settings) {
+  struct sigaction action;
+  action.sa_handler = &RequestProgress;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  sigaction(SIGUSR1, &action, KNAPSACK_NULLPTR);
+  if (!(settings.progress_ > 0)) {
+    return;
+  }
+  sigaction(SIGALRM, &action, KNAPSACK_NULLPTR);
+  struct itimerval timer;
+  timer.it_interval.tv_sec = static_cast<time_t>(settings.progress_);
+  timer.it_interval.tv_usec = static_cast<suseconds_t>(
+    (settings.progress_ - static_cast<double>(timer.it_interval.tv_sec)) *
+    1000000);
+  if ((timer.it_interval.tv_sec == 0) && (timer.it_interval.tv_usec == 0)) {
+    timer.it_interval.tv_usec = 1;
+  }
+  timer.it_value = timer.it_interval;
+  setitimer(ITIMER_REAL, &timer, KNAPSACK_NULLPTR);
+}
+
+// The resident memory of the process in bytes (0 if it is unknown)
+static std::size_t ResidentBytes() {
+  std::FILE *file(std::fopen("/proc/self/statm", "r"));
+  if (file == KNAPSACK_NULLPTR) {
+    return 0;
+  }
+  unsigned long size, resident;  // NOLINT(runtime/int)
+  bool success(std::fscanf(file, "%lu %lu", &size, &resident) == 2);
+  std::fclose(file);
+  long page(sysconf(_SC_PAGESIZE));  // NOLINT(runtime/int)
+  return ((success && (page > 0)) ?
+    static_cast<std::size_t>(resident) * static_cast<std::size_t>(page) : 0);
+}
+
+static string FormatProgressValue(const Progress& progress,
+    long double value) {
+  if (progress.float_) {
+    return (boost::format("%s") % value).str();
+  }
+  return (boost::format("%s") % static_cast<Integer>(value)).str();
+}
+
+// The KnapsackProgress function: Print a line of name=value pairs
+static void ReportProgress(const KnapsackProgressInfo& info, void *data) {
+  Progress *progress(static_cast<Progress *>(data));
+  double seconds(info.seconds_ - progress->seconds_);
+  std::size_t states((info.states_ < progress->states_) ? 0 :
+    (info.states_ - progress->states_));
+  string line((boost::format("knapsack: %sprogress: seconds=%.3f states=%s "
+    "states_per_second=%.0f entries=%s hash_bytes=%s") % progress->where_ %
+    info.seconds_ % info.states_ %
+    ((seconds > 0) ? (static_cast<double>(states) / seconds) : 0.0) %
+    info.entries_ % info.bytes_).str());
+  std::size_t resident(ResidentBytes());
+  if (resident != 0) {
+    line.append((boost::format(" rss_bytes=%s") % resident).str());
+  }
+  if (info.have_incumbent_) {
+    line.append((boost::format(" incumbent=%s bound=%s") %
+      FormatProgressValue(*progress, info.incumbent_) %
+      FormatProgressValue(*progress, info.bound_)).str());
+  }
+  line.append("\n");
+  fputs(line.c_str(), stderr);
+  progress->seconds_ = info.seconds_;
+  progress->states_ = info.states_;
+}
+
+KnapsackCommon *opt_parse(int argc, char *argv[], Settings *settings) {
   bool opt_quiet(false), opt_float(false), opt_force(false),
-    opt_version(false), opt_help(false);
+    opt_prune(false), opt_bundle(false), opt_value_only(false),
+    opt_incremental(false), opt_stats(false), opt_version(false),
+    opt_help(false);
   WordList opt_sack, opt_item;
+  string opt_max_memory, opt_engine("auto"), opt_batch, opt_memo_dir,
+    opt_sacks_from, opt_items_from;
+  unsigned int opt_jobs(1);
+  double opt_time_limit(-1), opt_epsilon(0), opt_progress(0);
   boost::program_options::options_description options("Options");
   options.add_options()
     ("sack,s", boost::program_options::value<WordList>(&opt_sack),
@@ -136,17 +720,119 @@ KnapsackCommon *opt_parse(int argc, char *argv[]) {
       "the knapsacks cannot carry more than N times this item only.)\n"
       "The symbol * can be replaced by : or x or X, and the symbol = "
       "can be replaced by ~ or # or @.")
+    ("sacks-from", boost::program_options::value<string>(&opt_sacks_from),
+      "add the knapsacks of the specified file (- means stdin): capacities "
+      "in the syntax of option -s, separated by spaces or newlines; empty "
+      "lines and lines starting with # are ignored.")
+    ("items-from", boost::program_options::value<string>(&opt_items_from),
+      "add the items of the specified file (- means stdin), one per line in "
+      "the syntax of option -i. The rest of the line (after spaces) is a "
+      "label, e.g. the name of a file, which is appended to the item in "
+      "brackets in the output. Empty lines and lines starting with # are "
+      "ignored. This is much faster than items on the command line and "
+      "not limited by the maximal length of the command line.")
     ("float,f", boost::program_options::bool_switch(&opt_float),
       "values of items can be fractional (floating point) numbers.\n"
       "Without this option, all values must be integer numbers. "
       "With this option, the result might be wrong due to (accumulative) "
       "rounding errors which are ignored by the algorithm.")
+    ("max-memory,m", boost::program_options::value<string>(&opt_max_memory),
+      "limit the memory used for the hashes to approximately the specified "
+      "number of bytes (a suffix K, M, or G can be used). "
+      "If the limit is reached, the states which were cheapest to calculate "
+      "are forgotten and calculated again if needed. This can cost much "
+      "time. A warning with the number of forgotten states is printed. "
+      "If forgetting does not free enough, the limit is checked less often "
+      "and can be exceeded, with another warning.")
+    ("prune,p", boost::program_options::bool_switch(&opt_prune),
+      "skip placements of items which cannot improve the best value found "
+      "so far, using an upper bound (of the linear relaxation) for the "
+      "remaining items. This is usually faster if there are many items. "
+      "The result is the same (up to rounding errors if option -f is used).")
+    ("bundle,b", boost::program_options::bool_switch(&opt_bundle),
+      "split items with a larger count N internally into bundles of "
+      "1, 2, 4, ... copies so that only about log(N) items are needed. "
+      "This is only done if there is one knapsack. The result is optimal, "
+      "but a different solution might be found.")
+    ("jobs,j", boost::program_options::value<unsigned int>(&opt_jobs),
+      "use the specified number of threads; 0 means one thread per core. "
+      "The result is the same for all numbers of threads. "
+      "In batch mode, the threads solve different instances.")
+    ("engine,e", boost::program_options::value<string>(&opt_engine),
+      "use the specified engine: hash, dense, bitset, or auto (the "
+      "default). The dense engine calculates all states in arrays; it is "
+      "only possible for one or two knapsacks and usually faster if their "
+      "capacities are small. The bitset engine is even faster but only "
+      "possible if additionally no values are specified. With auto, the "
+      "dense or bitset engine is used if it is expected to be faster and "
+      "needs not too much memory. "
+      "The result is the same for all engines.")
+    ("time-limit,t", boost::program_options::value<double>(&opt_time_limit),
+      "stop the calculation after the specified number of seconds "
+      "(which can be fractional). Then a greedy solution (items by "
+      "decreasing value per weight, placed into the first knapsacks into "
+      "which they fit) is output, and unless option -q is used, a warning "
+      "with an upper bound for the maximal value is printed. "
+      "With 0, only the greedy solution is calculated.")
+    ("progress,P", boost::program_options::value<double>(&opt_progress),
+      "print the progress of the hash engine to stderr every specified "
+      "number of seconds (which can be fractional) as a line of name=value "
+      "pairs: the seconds since the start, the states calculated so far "
+      "and per second since the previous line, the entries and bytes of "
+      "the hashes, the resident memory, and the value of the greedy "
+      "solution and an upper bound. Independent of this option, the "
+      "progress is printed when the process receives SIGUSR1.")
+    ("epsilon", boost::program_options::value<double>(&opt_epsilon),
+      "if positive, only approximate the maximal value: For one knapsack, "
+      "the result is at least (1 - epsilon) times the maximal value, and "
+      "the time is polynomial in the number of items and 1 / epsilon. "
+      "Several knapsacks are filled successively in this way (by "
+      "decreasing capacity); then the result is at least "
+      "(1 - epsilon) / (2 - epsilon) times the maximal value. If the greedy "
+      "solution is better, it is used instead. Unless option -q "
+      "is used, a warning with an upper bound for the maximal value is "
+      "printed if the result is not known to be optimal.")
+    ("memo-dir,M", boost::program_options::value<string>(&opt_memo_dir),
+      "keep the values of the calculated states in a file in the specified "
+      "(existing) directory. The file is named by a fingerprint of the "
+      "items and the number of knapsacks; later runs with the same items "
+      "(and possibly other capacities) reuse these states and add new "
+      "ones. This is only used by the hash engine and not with option "
+      "--epsilon. The result is the same.")
+    ("batch,B", boost::program_options::value<string>(&opt_batch),
+      "batch mode: read instances from the specified file (- means stdin), "
+      "one per line, each consisting of knapsacks (-s) and items as on the "
+      "command line; empty lines and lines starting with # are ignored. "
+      "The other options apply to all instances. The results are output in "
+      "the order of the instances, each followed by an empty line (unless "
+      "option -v is used). If an instance is invalid, an error is printed, "
+      "its result is empty, and the exit status is nonzero.")
+    ("incremental,I", boost::program_options::bool_switch(&opt_incremental),
+      "in batch mode, keep the hashes of the hash engine from one instance "
+      "to the next one (of the same thread) and remove only the states "
+      "which depend on changed items. This is faster if the items of "
+      "consecutive instances are mostly the same, in particular if items are "
+      "appended. The value is the same, but the solution might differ if "
+      "there are several.")
+    ("stats", boost::program_options::bool_switch(&opt_stats),
+      "print statistics of each calculation to stderr as a line of "
+      "name=value pairs: the states inserted into and looked up in the "
+      "hashes of the hash engine, the number found, the largest depth of "
+      "the calculation, the bytes of the hashes, and the seconds spent for "
+      "preprocessing, calculating the value, and finding the solution.")
+    ("value-only,v", boost::program_options::bool_switch(&opt_value_only),
+      "output only the maximal value and not how the items are placed. "
+      "This is faster and needs less memory.")
     ("quiet,q", boost::program_options::bool_switch(&opt_quiet),
-      "do not print warnings about ignored items/modified N")
+      "do not print warnings about ignored items/modified N "
+      "or about forgotten states")
     ("force,F", boost::program_options::bool_switch(&opt_force),
       "use items as specified on the command line, even if they are "
       "too heavy to fit anywhere or if some number could be treated as "
-      "unbound more effficiently. This serves mainly for debugging purposes, "
+      "unbound more effficiently. Also, identical items are not merged, "
+      "items which are dominated by an unbound item are not removed, and "
+      "weights are not divided by a common divisor. "
+      "This serves mainly for debugging purposes, "
       "but it could also be that a different solution is found with this "
       "option if several optimal solutions do exist")
     ("version,V", boost::program_options::bool_switch(&opt_version),
@@ -178,80 +864,230 @@ KnapsackCommon *opt_parse(int argc, char *argv[]) {
   } else {
     knapsack = new KnapsackInt;
   }
-  KnapsackCommon::WeightList& sack = knapsack->knapsack_;
-  for (WordList::const_iterator it(opt_sack.begin()); it != opt_sack.end();
-    ++it) {
-    WordList parts;
-    boost::split(parts, *it, boost::is_any_of(":*xX"));
-    if (parts.size() <= 1) {
-      sack.push_back(ParseNumber<Integer>(parts[0]));
-    } else {
-      sack.insert(sack.end(), ParseNumber<Integer>(parts[0]),
-        ParseNumber<Integer>(parts[1]));
+  settings->quiet_ = opt_quiet;
+  settings->value_only_ = opt_value_only;
+  settings->float_ = opt_float;
+  settings->force_ = opt_force;
+  settings->batch_ = opt_batch;
+  settings->sacks_from_ = opt_sacks_from;
+  settings->items_from_ = opt_items_from;
+  settings->incremental_ = opt_incremental;
+  settings->progress_ = opt_progress;
+#ifdef KNAPSACK_STATS
+  settings->stats_ = opt_stats;
+#else
+  if (opt_stats && !opt_quiet) {
+    Warn("statistics are not supported; ignoring option --stats");
+  }
+#endif
+  try {
+    if (!opt_max_memory.empty()) {
+      knapsack->set_max_memory(ParseSize(opt_max_memory));
     }
+  } catch (const ParseError& e) {
+    Die(e.what());
   }
-  if (knapsack->sack_empty()) {
-    Die("at least one knapsack must be specified, e.g. with option -s");
+  knapsack->set_prune(opt_prune);
+  knapsack->set_preprocess(!opt_force);
+  knapsack->set_bundle(opt_bundle);
+  if (opt_engine == "hash") {
+    knapsack->set_engine(KnapsackBase::kEngineHash);
+  } else if (opt_engine == "dense") {
+    knapsack->set_engine(KnapsackBase::kEngineDense);
+  } else if (opt_engine == "bitset") {
+    knapsack->set_engine(KnapsackBase::kEngineBitset);
+  } else if (opt_engine != "auto") {
+    Die(boost::format("unknown engine %s") % opt_engine);
   }
-  for (WordList::const_iterator it(opt_item.begin()); it != opt_item.end();
-    ++it) {
-    WordList parts;
-    boost::split(parts, *it, boost::is_any_of(":*xX \t\r\n"));
-    string rest;
-    Integer count;
-    if (parts.size() <= 1) {
-      rest = parts[0];
-      count = 1;
-    } else {
-      rest = parts[1];
-      count = ParseNumber<Integer>(parts[0], false);
+#ifdef KNAPSACK_THREADS
+  if (opt_jobs == 0) {
+    opt_jobs = std::thread::hardware_concurrency();
+  }
+#else
+  if ((opt_jobs > 1) && !opt_quiet) {
+    Warn("threads are not supported; ignoring option -j");
+  }
+  opt_jobs = 1;
+#endif
+  settings->jobs_ = opt_jobs;
+  knapsack->set_threads(opt_batch.empty() ? opt_jobs : 1);
+  knapsack->set_time_limit(opt_time_limit);
+  knapsack->set_epsilon(opt_epsilon);
+  knapsack->set_memo_dir(opt_memo_dir);
+  if (!opt_batch.empty()) {
+    if (!opt_sack.empty() || !opt_item.empty() || !opt_sacks_from.empty() ||
+      !opt_items_from.empty()) {
+      Die("in batch mode, knapsacks and items must not be specified "
+        "on the command line");
     }
-    boost::split(parts, rest, boost::is_any_of("=~#@"));
-    Integer weight(ParseNumber<Integer>(parts[0]));
-    if (!opt_force) {
-      Integer count_max(CountMax(*knapsack, weight));
-      if (count_max <= 0) {
-        if (!opt_quiet) {
-          Warn(boost::format("ignoring too heavy item %s") % *it);
-        }
+    return knapsack;
+  }
+  if (opt_incremental) {
+    Die("option --incremental needs option --batch");
+  }
+  if ((opt_sacks_from == "-") && (opt_items_from == "-")) {
+    Die("options --sacks-from and --items-from cannot both read stdin");
+  }
+  try {
+    ParseInstance(opt_sack, opt_item, *settings, "", knapsack);
+  } catch (const ParseError& e) {
+    Die(e.what());
+  }
+  return knapsack;
+}
+
+// The input and output of batch mode, shared by the threads
+class Batch {
+ public:
+  explicit Batch(std::istream *input)
+    : input_(input), line_(0), read_(0), written_(0), failed_(false) {
+  }
+
+  // Read the next instance; returns false at the end of the input.
+  // *index is the number of the instance, *where the prefix of messages.
+  bool Read(string *line, std::size_t *index, string *where) {
+#ifdef KNAPSACK_THREADS
+    std::lock_guard<std::mutex> lock(input_mutex_);
+#endif
+    while (std::getline(*input_, *line)) {
+      ++line_;
+      string::size_type start(line->find_first_not_of(" \t\r"));
+      if ((start == string::npos) || ((*line)[start] == '#')) {
         continue;
       }
-      if (count >= count_max) {
-        if (!opt_quiet) {
-          Warn(boost::format("treating item %s as unbound (N=0) "
-            "for efficiency") % *it);
-        }
-        count = 0;
-      }
+      *index = read_++;
+      *where = (boost::format("line %s: ") % line_).str();
+      return true;
     }
-    knapsack->count_.push_back(count);
-    knapsack->weight_.push_back(weight);
-    if (parts.size() <= 1) {
-      if (opt_float) {
-        static_cast<KnapsackFloat *>(knapsack)->value_.push_back(0);
-      } else {
-        static_cast<KnapsackInt *>(knapsack)->value_.push_back(0);
-      }
-    } else {
-      if (opt_float) {
-        static_cast<KnapsackFloat *>(knapsack)->value_.push_back(
-          ParseNumber<Float>(parts[1]));
+    return false;
+  }
+
+  // Output the result of instance index after those of all previous ones
+  void Write(std::size_t index, const string& result, bool failed) {
+#ifdef KNAPSACK_THREADS
+    std::lock_guard<std::mutex> lock(output_mutex_);
+#endif
+    failed_ = (failed_ || failed);
+    pending_[index] = result;
+    for (std::map<std::size_t, string>::iterator it;
+      ((it = pending_.find(written_)) != pending_.end()); ++written_) {
+      fputs(it->second.c_str(), stdout);
+      pending_.erase(it);
+    }
+    std::fflush(stdout);
+  }
+
+  bool failed() const {
+    return failed_;
+  }
+
+ private:
+  std::istream *input_;
+  std::size_t line_, read_, written_;
+  bool failed_;
+  std::map<std::size_t, string> pending_;  // the results not yet written
+#ifdef KNAPSACK_THREADS
+  std::mutex input_mutex_, output_mutex_;
+#endif
+};
+
+// Solve the instances of batch with a copy of prototype which is reused
+// (together with its arena) for all instances
+template<class KnapsackType> void BatchWork(const KnapsackType *prototype,
+    const Settings *settings, Batch *batch) {
+  KnapsackType knapsack(*prototype);
+  knapsack.set_keep_arena(true);
+  Progress progress(settings->float_);
+  knapsack.set_progress(&ReportProgress, &progress_request, &progress);
+  typename KnapsackType::Session session(knapsack);
+  string line, where;
+  std::size_t index;
+  while (batch->Read(&line, &index, &where)) {
+    string result;
+    bool failed(false);
+    knapsack.reset();
+    progress.Restart(where);
+    try {
+      WordList sack, item;
+      ParseLine(line, &sack, &item);
+      ParseInstance(sack, item, *settings, where, &knapsack);
+      if (!settings->incremental_) {
+        SolveInstance(knapsack, *settings, where, &result);
       } else {
-        static_cast<KnapsackInt *>(knapsack)->value_.push_back(
-          ParseNumber<Integer>(parts[1]));
+        if (settings->value_only_) {
+          session.SolveValueAppend(&result);
+        } else {
+          session.SolveAppend(&result);
+        }
+        ReportSolved(knapsack, *settings, where);
       }
+    } catch (const std::exception& e) {
+      fputs((boost::format("knapsack: %s%s\n") % where % e.what()).str()
+        .c_str(), stderr);
+      result.clear();
+      failed = true;
     }
+    if (failed && settings->value_only_) {
+      result = "\n";
+    } else if (!settings->value_only_) {
+      result.append("\n");
+    }
+    batch->Write(index, result, failed);
   }
-  if (knapsack->empty()) {
-    Die("at least one not too heavy item must be specified");
+}
+
+template<class KnapsackType> int RunThreads(const KnapsackType *prototype,
+    const Settings& settings, Batch *batch) {
+#ifdef KNAPSACK_THREADS
+  std::vector<std::thread> thread;
+  for (unsigned int i(1); i < settings.jobs_; ++i) {
+    thread.push_back(std::thread(&BatchWork<KnapsackType>, prototype,
+      &settings, batch));
   }
-  return knapsack;
+#endif
+  BatchWork(prototype, &settings, batch);
+#ifdef KNAPSACK_THREADS
+  for (std::vector<std::thread>::iterator it(thread.begin());
+    it != thread.end(); ++it) {
+    it->join();
+  }
+#endif
+  return (batch->failed() ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+static int RunBatch(const KnapsackCommon& prototype,
+    const Settings& settings) {
+  std::ifstream file;
+  std::istream *input(&std::cin);
+  if (settings.batch_ != "-") {
+    file.open(settings.batch_.c_str());
+    if (!file) {
+      Die(boost::format("cannot open %s") % settings.batch_);
+    }
+    input = &file;
+  }
+  Batch batch(input);
+  if (settings.float_) {
+    return RunThreads(static_cast<const KnapsackFloat *>(&prototype), settings,
+      &batch);
+  }
+  return RunThreads(static_cast<const KnapsackInt *>(&prototype), settings,
+    &batch);
 }
 
 int main(int argc, char *argv[]) {
-  KnapsackCommon *knapsack(opt_parse(argc, argv));
+  Settings settings;
+  KnapsackCommon *knapsack(opt_parse(argc, argv, &settings));
+  Progress progress(settings.float_);
+  knapsack->set_progress(&ReportProgress, &progress_request, &progress);
+  InstallProgress(settings);
+  if (!settings.batch_.empty()) {
+    int status(RunBatch(*knapsack, settings));
+    delete knapsack;
+    return status;
+  }
   string result;
-  knapsack->SolveAppend(&result);
+  SolveInstance(*knapsack, settings, "", &result);
   delete knapsack;
   fputs(result.c_str(), stdout);
   return EXIT_SUCCESS;
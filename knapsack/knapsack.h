@@ -9,22 +9,283 @@
 #define KNAPSACK_KNAPSACK_H_ 1
 
 #include <boost/format.hpp>  // boost::format
-#include <boost/unordered_map.hpp>  // boost::unordered_map and hash stuff
+#include <boost/functional/hash.hpp>  // boost::hash_combine
 
+#include <algorithm>  // std::sort
+#include <csignal>  // std::sig_atomic_t
 #include <cstdlib>  // std::size_t
 
+#include <limits>
 #include <map>
 #include <set>
 #include <string>
 #include <utility>  // std::pair
 #include <vector>
 
+#if (__cplusplus >= 201103L) && !defined(KNAPSACK_NO_THREADS)
+#define KNAPSACK_THREADS 1
+#endif
+
+#ifdef KNAPSACK_THREADS
+#include <atomic>
+#include <exception>  // std::exception_ptr
+#include <memory>  // std::unique_ptr
+#include <mutex>
+#include <thread>
+#endif
+
+#include "knapsack/approximate.h"
+#include "knapsack/arena.h"
+#include "knapsack/deadline.h"
+#include "knapsack/dense.h"
+#include "knapsack/memo_file.h"
+#include "knapsack/memo_table.h"
+#include "knapsack/nullptr.h"
+#include "knapsack/progress.h"
+#include "knapsack/sack_state.h"
+#include "knapsack/stats.h"
+#include "knapsack/subset_sum.h"
+
 class KnapsackBase {
  public:
+  // The engine used by Solve(), see set_engine()
+  enum Engine {
+    kEngineAuto,
+    kEngineHash,
+    kEngineDense,
+    kEngineBitset
+  };
+
+  KnapsackBase()
+    : max_memory_(0), evicted_(0), memory_exceeded_(false), prune_(false),
+    threads_(1), engine_(kEngineAuto), engine_used_(kEngineAuto),
+    preprocess_(true), bundle_(false), time_limit_(-1),
+    cancel_(KNAPSACK_NULLPTR), cancel_data_(KNAPSACK_NULLPTR),
+    progress_(KNAPSACK_NULLPTR), progress_request_(KNAPSACK_NULLPTR),
+    progress_data_(KNAPSACK_NULLPTR), epsilon_(0), optimal_(true),
+    memo_failed_(false) {
+  }
+
   virtual ~KnapsackBase() {
   }
 
   virtual void SolveAppend(std::string *str) const = 0;
+  virtual void SolveValueAppend(std::string *str) const = 0;
+  virtual void UpperBoundAppend(std::string *str) const = 0;
+
+  // Limit the memory used by the hashes (approximately) to the given number
+  // of bytes; 0 means no limit. If the limit is reached, the entries which
+  // needed the least calculation are evicted (and calculated again if needed)
+  void set_max_memory(std::size_t bytes) {
+    max_memory_ = bytes;
+  }
+
+  std::size_t get_max_memory() const {
+    return max_memory_;
+  }
+
+  // The number of entries evicted in the last call of Solve()
+  std::size_t evicted() const {
+    return evicted_;
+  }
+
+  // Whether the hashes of the last call of Solve() needed more memory than
+  // the limit even after evicting entries
+  bool memory_exceeded() const {
+    return memory_exceeded_;
+  }
+
+  // If true, Solve() skips the placements of an item whose value plus an
+  // upper bound for the remaining items cannot exceed the best value found
+  void set_prune(bool prune) {
+    prune_ = prune;
+  }
+
+  bool get_prune() const {
+    return prune_;
+  }
+
+  // The number of threads used by Solve(). Values larger than 1 have only
+  // an effect if threads are supported (see KNAPSACK_THREADS).
+  void set_threads(unsigned int threads) {
+    threads_ = threads;
+  }
+
+  unsigned int get_threads() const {
+    return threads_;
+  }
+
+  // kEngineHash calculates only the states which are needed and stores
+  // them in hashes. kEngineDense calculates all states in arrays (see
+  // knapsack/dense.h); this is only possible for one or two knapsacks with
+  // integral weights and is often much faster for small capacities.
+  // kEngineBitset is like kEngineDense but only possible if additionally
+  // the value of each item is its weight; it stores only the reachable sums
+  // as bitsets (see knapsack/subset_sum.h) and is even faster.
+  // kEngineAuto uses kEngineBitset or kEngineDense if this is possible and
+  // expected to be faster without needing too much memory.
+  void set_engine(Engine engine) {
+    engine_ = engine;
+  }
+
+  Engine get_engine() const {
+    return engine_;
+  }
+
+  // The engine which calculated the last call of Solve(); kEngineAuto if
+  // none did (e.g. for the approximation scheme of set_epsilon())
+  Engine engine_used() const {
+    return engine_used_;
+  }
+
+  // If true (the default), Solve() first simplifies the items: Identical
+  // bound items are merged, items which are dominated by an unbound item
+  // (i.e. not lighter and not more valuable) or fit into no knapsack are
+  // removed, and all weights and capacities are divided by their greatest
+  // common divisor. The result still refers to the original items.
+  void set_preprocess(bool preprocess) {
+    preprocess_ = preprocess;
+  }
+
+  bool get_preprocess() const {
+    return preprocess_;
+  }
+
+  // If true, Solve() splits each bound item with a larger count into bundles
+  // of 1, 2, 4, ... copies: This reduces the number of states for large
+  // counts. This is done only if there is one knapsack, since otherwise
+  // the copies of a bundle could not be distributed to several knapsacks.
+  void set_bundle(bool bundle) {
+    bundle_ = bundle;
+  }
+
+  bool get_bundle() const {
+    return bundle_;
+  }
+
+  // Limit the time of Solve() to the given number of seconds; a negative
+  // number (the default) means no limit. If the limit is reached, Solve()
+  // returns the best solution known so far (see IsOptimal()).
+  void set_time_limit(double seconds) {
+    time_limit_ = seconds;
+  }
+
+  double get_time_limit() const {
+    return time_limit_;
+  }
+
+  // Solve() calls cancel(data) regularly (from several threads at once if
+  // set_threads() is used); if it returns true, Solve() stops as when the
+  // time limit is reached. It should then keep returning true.
+  // A null pointer (the default) means that Solve() is not cancelled.
+  void set_cancel(KnapsackCancel cancel, void *data = KNAPSACK_NULLPTR) {
+    cancel_ = cancel;
+    cancel_data_ = data;
+  }
+
+  // If progress is nonzero, the hash engine of Solve() regularly checks
+  // whether *request is nonzero (e.g. set by a signal handler); then it
+  // resets *request and calls progress(info, data) from the calling thread
+  // (see knapsack/progress.h). The greedy solution is calculated first so
+  // that info contains it.
+  void set_progress(KnapsackProgress progress,
+      volatile std::sig_atomic_t *request, void *data = KNAPSACK_NULLPTR) {
+    progress_ = progress;
+    progress_request_ = request;
+    progress_data_ = data;
+  }
+
+  // If positive, Solve() only approximates the maximal value: For one
+  // knapsack, the result is at least (1 - epsilon) times the maximum, and
+  // the time is polynomial in the number of items and 1 / epsilon.
+  // Several knapsacks are filled successively by this scheme; then the
+  // result is at least (1 - epsilon) / (2 - epsilon) times the maximum.
+  void set_epsilon(double epsilon) {
+    epsilon_ = epsilon;
+  }
+
+  double get_epsilon() const {
+    return epsilon_;
+  }
+
+  // If nonempty, Solve() with the hash engine keeps the values of the
+  // states it calculated in a file in the directory dir, named by a
+  // fingerprint of the items and the number of knapsacks (see
+  // knapsack/memo_file.h). Later calls with the same items (also in other
+  // processes, possibly with other capacities) take the values from the
+  // file instead of calculating them and add their new states to the file.
+  void set_memo_dir(const std::string& dir) {
+    memo_dir_ = dir;
+  }
+
+  const std::string& get_memo_dir() const {
+    return memo_dir_;
+  }
+
+  // Whether the last Solve() failed to write the file of set_memo_dir()
+  bool memo_failed() const {
+    return memo_failed_;
+  }
+
+  // Whether the result of the last Solve() is proven to be optimal; this is
+  // false only if Solve() was stopped by the time limit or by set_cancel()
+  // or if set_epsilon() is used
+  bool IsOptimal() const {
+    return optimal_;
+  }
+
+  // The statistics of the last Solve() (see knapsack/stats.h)
+  const KnapsackStats& get_stats() const {
+    return stats_;
+  }
+
+ protected:
+  std::size_t max_memory_;
+  mutable std::size_t evicted_;
+  mutable bool memory_exceeded_;
+  bool prune_;
+  unsigned int threads_;
+  Engine engine_;
+  mutable Engine engine_used_;
+  bool preprocess_, bundle_;
+  double time_limit_;
+  KnapsackCancel cancel_;
+  void *cancel_data_;
+  KnapsackProgress progress_;
+  volatile std::sig_atomic_t *progress_request_;
+  void *progress_data_;
+  double epsilon_;
+  mutable bool optimal_;
+  std::string memo_dir_;
+  mutable bool memo_failed_;
+  mutable KnapsackStats stats_;
+
+  // Whether Solve() might be stopped early
+  bool Limited() const {
+    return ((time_limit_ >= 0) || (cancel_ != KNAPSACK_NULLPTR));
+  }
+};
+
+// The greatest common divisor (only for integer types; otherwise 1)
+template <class T, bool kInteger = std::numeric_limits<T>::is_integer>
+class KnapsackGcd {
+ public:
+  static T Gcd(T a, T b) {
+    while (b != 0) {
+      T rest(a % b);
+      a = b;
+      b = rest;
+    }
+    return a;
+  }
+};
+
+template <class T>
+class KnapsackGcd<T, false> {
+ public:
+  static T Gcd(T /* a */, T /* b */) {
+    return 1;
+  }
 };
 
 template <class Weight, class Count = typename std::vector<Weight>::size_type>
@@ -38,6 +299,8 @@ class KnapsackWeight : public KnapsackBase {
   typedef Count count_type;
   typedef typename std::vector<count_type> CountList;
   CountList count_;
+  typedef std::vector<std::string> LabelList;
+  LabelList label_;
 
   bool empty() const {
     return weight_.empty();
@@ -66,14 +329,29 @@ class KnapsackWeight : public KnapsackBase {
     return count_[index];
   }
 
+  // The label of an item is only used for the output of SolveAppend()
+  bool HasLabel(size_type index) const {
+    return ((index < label_.size()) && !label_[index].empty());
+  }
+
   virtual void clear() {
     weight_ = knapsack_ = WeightList();
     count_ = CountList();
+    label_ = LabelList();
+  }
+
+  // Like clear(), but the memory of the lists is kept for the next instance
+  virtual void reset() {
+    weight_.clear();
+    knapsack_.clear();
+    count_.clear();
+    label_.clear();
   }
 };
 
 template <class Weight, class Value,
-    class Count = typename std::vector<Weight>::size_type> class Knapsack
+    class Count = typename std::vector<Weight>::size_type,
+    class Allocator = KnapsackArenaAllocator<Weight> > class Knapsack
   : public KnapsackWeight<Weight, Count> {
  public:
   typedef KnapsackWeight<Weight, Count> super;
@@ -82,6 +360,27 @@ template <class Weight, class Value,
   using typename super::count_type;
   using super::weight_;
   using super::knapsack_;
+  using super::label_;
+  using super::max_memory_;
+  using super::evicted_;
+  using super::memory_exceeded_;
+  using super::prune_;
+  using super::threads_;
+  using super::engine_;
+  using super::engine_used_;
+  using super::preprocess_;
+  using super::bundle_;
+  using super::time_limit_;
+  using super::cancel_;
+  using super::cancel_data_;
+  using super::progress_;
+  using super::progress_request_;
+  using super::progress_data_;
+  using super::epsilon_;
+  using super::optimal_;
+  using super::memo_dir_;
+  using super::memo_failed_;
+  using super::stats_;
 
   typedef Value value_type;
   typedef std::vector<value_type> ValueList;
@@ -98,62 +397,106 @@ template <class Weight, class Value,
     return value_[index];
   }
 
+  typedef Allocator allocator_type;
+
+  Knapsack()
+    : upper_bound_(0), keep_arena_(false), session_(KNAPSACK_NULLPTR),
+    reporter_(KNAPSACK_NULLPTR) {
+  }
+
   virtual void clear() {
     value_ = ValueList();
+    arena_.Release();
     super::clear();
   }
 
- private:
-  typedef typename std::multiset<Weight> WeightSet;
-
-  // A class containing all data of bound items:
-  // item (first) and its count (second)
-  typedef std::pair<size_type, count_type> BoundItem;
+  // Like clear(), but the memory of the lists and of the arena (if
+  // set_keep_arena(true) is used) is kept for the next instance
+  virtual void reset() {
+    value_.clear();
+    super::reset();
+  }
 
-  // A class which serves as the hash index for bound items
-  class BoundIndex {
-   public:
-    typedef typename Knapsack<Weight, Value, Count>::BoundItem BoundItem;
-    typedef typename KnapsackWeight<Weight, Count>::size_type size_type;
-    typedef typename KnapsackWeight<Weight, Count>::count_type count_type;
-    typedef typename Knapsack<Weight, Value, Count>::WeightSet WeightSet;
+  // If true, the memory of the arena is kept after Solve() for reuse
+  void set_keep_arena(bool keep) {
+    keep_arena_ = keep;
+    if (!keep) {
+      arena_.Release();
+    }
+  }
 
-    BoundItem bound_item_;
-    WeightSet sack_set_;
+  bool get_keep_arena() const {
+    return keep_arena_;
+  }
 
-    BoundIndex(const BoundItem& bound_item, const WeightSet& sack_set)
-      : bound_item_(bound_item), sack_set_(sack_set) {
-    }
+  // The bytes currently allocated by the arena (nonzero only if kept)
+  std::size_t arena_bytes() const {
+    return arena_.bytes();
+  }
 
-    void assign(const BoundItem& bound_item, const WeightSet& sack_set) {
-      bound_item_ = bound_item;
-      sack_set_ = sack_set;
-    }
+  // An upper bound for the maximal value of the last Solve(); if
+  // IsOptimal(), this is the value returned by Solve()
+  value_type get_upper_bound() const {
+    return upper_bound_;
+  }
 
-    friend std::size_t hash_value(const BoundIndex& b) {
-      std::size_t seed(0);
-      boost::hash_combine(seed, b.bound_item_);
-      boost::hash_combine(seed, b.sack_set_);
-      return seed;
-    }
+ private:
+  mutable value_type upper_bound_;
 
-    bool operator==(const BoundIndex& b) const {
-      return ((bound_item_ == b.bound_item_) && (sack_set_ == b.sack_set_));
-    }
+  // All temporary data of Solve() is allocated from this arena (if Allocator
+  // makes use of it); the arena is released or reset after Solve().
+  mutable KnapsackArena arena_;
+  bool keep_arena_;
 
-    const BoundItem& get_bound() const {
-      return bound_item_;
+  // Release or reset the arena at the end of Solve(), even on exceptions
+  class ArenaGuard {
+   public:
+    ArenaGuard(KnapsackArena *arena, bool keep)
+      : arena_(arena), keep_(keep) {
     }
 
-    size_type get_item() const {
-      return bound_item_.first;
+    ~ArenaGuard() {
+      if (keep_) {
+        arena_->Reset();
+      } else {
+        arena_->Release();
+      }
     }
 
-    count_type get_count() const {
-      return bound_item_.second;
-    }
+   private:
+    KnapsackArena *arena_;
+    bool keep_;
   };
 
+  // The sorted residual capacities of the knapsacks
+  typedef KnapsackState<Weight,
+    typename Allocator::template rebind<Weight>::other> WeightSet;
+
+  // The maximal number of knapsacks for which the entries of the hashes
+  // store the positions of all best placements (see Follow())
+  static const size_type kMaxPositions = 64;
+
+  // A class containing all data of bound items:
+  // item (first) and its count (second)
+  typedef std::pair<size_type, count_type> BoundItem;
+
+  // The hash of a bound state; the hash of sack_set is maintained in O(1)
+  static std::size_t HashBound(const BoundItem& bound_item,
+      const WeightSet& sack_set) {
+    std::size_t seed(sack_set.get_hash());
+    boost::hash_combine(seed, bound_item.first);
+    boost::hash_combine(seed, bound_item.second);
+    return seed;
+  }
+
+  // The entries store the position of the selected knapsack in the sorted
+  // WeightSet (and not the index of the knapsack): Only the position is
+  // independent of the order in which the residual capacities were reached.
+  // For the same reason, they also store the positions of all placements of
+  // the item which are as good as the selected one (see Follow()).
+  // Moreover, they refer to the hash entry of the successor state: the state
+  // after the placement or, if none is selected, the state for the next
+  // bound item.
   class EntryBound {
    public:
     typedef typename KnapsackWeight<Weight, Count>::size_type size_type;
@@ -175,22 +518,48 @@ template <class Weight, class Value,
       value_ = value;
     }
 
-    void Select(size_type sack, value_type value) {
+    // The hash entry of the successor state; 0 if there is none or if it
+    // is unknown
+    const void *get_next() const {
+      return next_;
+    }
+
+    // The positions (as bits) of the best placements; they are only
+    // maintained for at most kMaxPositions knapsacks
+    boost::uint64_t get_positions() const {
+      return positions_;
+    }
+
+    void Select(size_type sack, value_type value, const void *next,
+        boost::uint64_t positions) {
       sack_ = sack + 1;
       value_ = value;
+      next_ = next;
+      positions_ = positions;
+    }
+
+    // Add positions of placements which are as good as the selected one
+    void AddPositions(boost::uint64_t positions) {
+      positions_ |= positions;
+    }
+
+    void CopyTo(EntryBound *entry) const {
+      *entry = *this;
     }
 
     EntryBound()
-      : sack_(0) {
+      : sack_(0), next_(KNAPSACK_NULLPTR), positions_(0) {
     }
 
-    explicit EntryBound(Value value)
-      : sack_(0), value_(value) {
+    EntryBound(Value value, const void *next)
+      : sack_(0), value_(value), next_(next), positions_(0) {
     }
 
    private:
     size_type sack_;
     value_type value_;
+    const void *next_;
+    boost::uint64_t positions_;
   };
 
   class EntryUnbound : public EntryBound {
@@ -203,301 +572,2711 @@ template <class Weight, class Value,
       return item_;
     }
 
-    void Select(size_type item, size_type sack, value_type value) {
+    void Select(size_type item, size_type sack, value_type value,
+        const void *next, boost::uint64_t positions) {
       item_ = item;
-      super::Select(sack, value);
+      super::Select(sack, value, next, positions);
     }
 
     EntryUnbound() {
     }
 
-    explicit EntryUnbound(value_type value)
-      : super(value) {
+    EntryUnbound(value_type value, const void *next)
+      : super(value, next) {
+    }
+
+    void CopyTo(EntryUnbound *entry) const {
+      *entry = *this;
     }
 
    private:
     size_type item_;
   };
 
-  // A class containing all data needed only temporarily for calculation
-  class Calc {
+  // The entry of the hashes if only the value of Solve() is needed:
+  // The decisions are not stored, and the restored entries select nothing.
+  class EntryValue {
    public:
-    typedef typename Knapsack<Weight, Value, Count>::WeightSet WeightSet;
-    typedef typename boost::unordered_map<BoundIndex, EntryBound> BoundHash;
-    typedef typename boost::unordered_map<WeightSet, EntryUnbound> UnboundHash;
-    typedef typename KnapsackWeight<Weight, Count>::size_type size_type;
-    typedef typename KnapsackWeight<Weight, Count>::count_type count_type;
-    typedef typename KnapsackWeight<Weight, Count>::WeightList WeightList;
+    explicit EntryValue(const EntryBound& entry)
+      : value_(entry.get_value()) {
+    }
 
-    WeightSet sack_set_;
-    BoundHash bound_hash_;
-    UnboundHash unbound_hash_;
-    bool have_bound_;
-    BoundItem bound_;
+    value_type get_value() const {
+      return value_;
+    }
+
+    void CopyTo(EntryBound *entry) const {
+      *entry = EntryBound(value_, KNAPSACK_NULLPTR);
+    }
+
+    void CopyTo(EntryUnbound *entry) const {
+      *entry = EntryUnbound(value_, KNAPSACK_NULLPTR);
+    }
 
    private:
-    typedef typename WeightSet::iterator Iterator;
-    typedef std::vector<Iterator> IteratorList;
-    IteratorList iterator_;
+    value_type value_;
+  };
 
-    // This class is only meant to be used statically:
-    Calc() {}
-    Calc(const Calc&) {}
-    Calc& operator=(const Calc&) {}
+  // The file of set_memo_dir()
+  typedef KnapsackMemoFile<Value, Allocator> MemoFile;
 
+  // The predicates of KnapsackMemo::RemoveIf() for Memo::Invalidate()
+  class RemoveAll {
    public:
-    explicit Calc(const WeightList& weight_list)
-      : have_bound_(false) {
-      iterator_ = IteratorList(weight_list.size(), sack_set_.end());
-      typename WeightList::const_iterator sit(weight_list.begin());
-      for (typename IteratorList::iterator it(iterator_.begin()),
-        it_end(iterator_.end()); it != it_end; ++it, ++sit) {
-        *it = sack_set_.insert(*sit);
-      }
+    bool operator()(const KnapsackNoHeader& /* header */) const {
+      return true;
     }
+  };
 
-    void SetBound(size_type item, count_type count) {
-      bound_ = BoundItem(item, count);
-      have_bound_ = true;
+  class RemoveFrom {
+   public:
+    explicit RemoveFrom(size_type first)
+      : first_(first) {
     }
 
-    weight_type SackMax(size_type index) const {
-      return *iterator_[index];
+    bool operator()(const BoundItem& header) const {
+      return (header.first >= first_);
     }
 
-    // It is the caller's responsibility to ensure that no underflow occurs
-    void DecreaseBy(size_type index, weight_type subtract) {
-      Iterator *it_pointer(&(iterator_[index]));
-      Iterator it(*it_pointer);
-      weight_type new_weight(static_cast<weight_type>(*it - subtract));
-      sack_set_.erase(it);
-      *it_pointer = sack_set_.insert(new_weight);
-    }
+   private:
+    size_type first_;
+  };
 
-    void DecreaseTo(size_type index, weight_type new_weight) {
-      Iterator& it_reference = iterator_[index];
-      sack_set_.erase(it_reference);
-      it_reference = sack_set_.insert(new_weight);
+  // The hashes of the calculation, limited by max_memory (0 means no limit).
+  // Bound and Unbound are the types of the stored entries: EntryBound and
+  // EntryUnbound or, if only the values are needed, EntryValue.
+  template <class Bound, class Unbound>
+  class Memo {
+   public:
+    typedef KnapsackMemo<WeightSet, BoundItem, Bound, Allocator> BoundHash;
+    typedef KnapsackMemo<WeightSet, KnapsackNoHeader, Unbound, Allocator>
+      UnboundHash;
+    typedef typename BoundHash::cost_type cost_type;
+
+    BoundHash bound_hash_;
+    UnboundHash unbound_hash_;
+
+    // The number of entries evicted due to the memory limit
+    std::size_t evicted_;
+
+    // Whether the memory limit could not be kept by evicting entries
+    bool exceeded_;
+
+    Memo(size_type sacks, std::size_t max_memory, const Allocator& allocator)
+      : bound_hash_(sacks, allocator), unbound_hash_(sacks, allocator),
+      evicted_(0), exceeded_(false), max_memory_(max_memory), inserted_(0),
+      next_check_(kCheckInterval), check_interval_(kCheckInterval) {
     }
 
-    // A separate function for possibly optimizing a different implementation
-    void IncreaseTo(size_type index, weight_type new_weight) {
-      DecreaseTo(index, new_weight);
+    // Copy the entry of the state and return its address in the hash
+    // (0 if it is not found); the address is valid until entries are evicted
+    const Unbound *FindUnbound(const WeightSet& state, EntryUnbound *entry) {
+      const Unbound *found(unbound_hash_.Find(state.get_hash(),
+        KnapsackNoHeader(), state));
+      if (found != KNAPSACK_NULLPTR) {
+        found->CopyTo(entry);
+      }
+      return found;
     }
-  };
 
-  // Returns the first bound item index starting at item (possibly end of list)
-  size_type FirstBound(size_type item) const {
-    for (; item != super::size() ; ++item) {
-      if (super::IsBound(item)) {
-        return item;
+    const Bound *FindBound(std::size_t hash, const BoundItem& bound,
+        const WeightSet& state, EntryBound *entry) {
+      const Bound *found(bound_hash_.Find(hash, bound, state));
+      if (found != KNAPSACK_NULLPTR) {
+        found->CopyTo(entry);
       }
+      return found;
     }
-    return item;
-  }
 
-  // Returns max according to calc->sack_set_,
-  // assuming no bound item has been used.
-  // It is assumed that super::size() and super::sack_size() are at least 1
-  value_type SolveUnbound(Calc *calc) const {
-    WeightSet& sack_set = calc->sack_set_;
-    typename Calc::UnboundHash& hash = calc->unbound_hash_;
+    const Unbound *InsertUnbound(const WeightSet& state,
+        const EntryUnbound& entry, cost_type cost) {
+      CheckMemory();
+      return unbound_hash_.Insert(state.get_hash(), KnapsackNoHeader(), state,
+        Unbound(entry), cost);
+    }
 
-    // Return cached result if possible
-    const typename Calc::UnboundHash::const_iterator
-      found(hash.find(calc->sack_set_));
-    if (found != hash.end()) {
-      return found->second.get_value();
+    const Bound *InsertBound(std::size_t hash, const BoundItem& bound,
+        const WeightSet& state, const EntryBound& entry, cost_type cost) {
+      CheckMemory();
+      return bound_hash_.Insert(hash, bound, state, Bound(entry), cost);
     }
 
-    // First try without using any item
-    EntryUnbound entry(calc->have_bound_ ? SolveBound(calc) : 0);
+    // Add all entries to file (see MemoFile::Save())
+    void SaveTo(MemoFile *file) const {
+      typename MemoFile::Collect bound(file, MemoFile::kBound),
+        unbound(file, MemoFile::kUnbound);
+      bound_hash_.Visit(&bound);
+      unbound_hash_.Visit(&unbound);
+    }
 
-    // Place each unbound item into each sack and recurse
-    for (size_type item(super::size() - 1); ; --item) {
-      if (!super::IsBound(item)) {
-        weight_type weight(weight_[item]);
-        value_type value(get_value(item));
-        for (size_type sack(super::sack_size() - 1); ; --sack) {
-          weight_type sackmax(calc->SackMax(sack));
-          if (weight <= sackmax) {
-            calc->DecreaseTo(sack, sackmax - weight);
-            value_type new_value(SolveUnbound(calc) + value);
-            calc->IncreaseTo(sack, sackmax);
-            if (new_value > entry.get_value()) {
-              entry.Select(item, sack, new_value);
-            }
-          }
-          if (sack == 0) {
-            break;
-          }
-        }
-      }
-      if (item == 0) {
-        break;
-      }
+    // Add the bytes of the hashes to stats
+    void CountBytes(KnapsackStats *stats) const {
+      stats->unbound_bytes_ += unbound_hash_.bytes();
+      stats->bound_bytes_ += bound_hash_.bytes();
     }
 
-    // Cache result
-    hash[sack_set] = entry;
-    return entry.get_value();
-  }
+    // Add the entries and bytes of the hashes to info
+    void CountEntries(KnapsackProgressInfo *info) const {
+      info->entries_ += unbound_hash_.size() + bound_hash_.size();
+      info->bytes_ += unbound_hash_.bytes() + bound_hash_.bytes();
+    }
 
-  // Returns max using only bound items calc->bound_.first or later,
-  // the first item at most calc->bound_.second times,
-  // according to current calc->sack_set_.
-  // It is assumed that super::sack_size() is at least 1, and moreover:
-  // calc->bound_.first must be the index of a bound item, and
-  // calc->bound_.second must be positive
-  value_type SolveBound(Calc *calc) const {
-    typename Calc::BoundHash& hash = calc->bound_hash_;
+    std::size_t size() const {
+      return bound_hash_.size() + unbound_hash_.size();
+    }
 
-    // Return cached result if possible
-    BoundIndex bound_index(calc->bound_, calc->sack_set_);
-    const typename Calc::BoundHash::const_iterator
-      found(hash.find(bound_index));
-    if (found != hash.end()) {
-      return found->second.get_value();
+    // Remove all unbound entries and the bound entries whose header
+    // (see Calc::Header()) refers to an item from first on; returns the
+    // number of removed entries
+    std::size_t Invalidate(size_type first) {
+      return unbound_hash_.RemoveIf(RemoveAll()) +
+        bound_hash_.RemoveIf(RemoveFrom(first));
     }
 
-    size_type item(bound_index.get_item());
+   private:
+    static const std::size_t kCheckInterval = 4096;
+
+    // The percentage of max_memory_ to which CheckMemory() evicts
+    static const unsigned int kLowWater = 75;
+
+    std::size_t max_memory_, inserted_, next_check_, check_interval_;
+
+    // Every check_interval_ inserted entries, the memory limit is checked.
+    // If it is exceeded, the entries which are cheapest to calculate again
+    // are evicted, about as many as needed to get down to kLowWater percent
+    // of the limit. (Evicting a fixed half of the entries at every check
+    // made the calculation grow exponentially: The evicted entries are
+    // calculated and inserted again, which soon leads to the next check.)
+    // If the eviction does not free enough, e.g. since the slots of the
+    // hashes are not freed or all entries have similar costs, the check
+    // interval is doubled, and exceeded_ is set since the limit is then not
+    // kept; a successful eviction restores the interval.
+    void CheckMemory() {
+      if ((max_memory_ == 0) || (++inserted_ < next_check_)) {
+        return;
+      }
+      next_check_ = inserted_ + check_interval_;
+      std::size_t bytes(bound_hash_.bytes() + unbound_hash_.bytes());
+      if (bytes <= max_memory_) {
+        return;
+      }
+      std::size_t low_water(max_memory_ / 100 * kLowWater);
+      KnapsackCostHistogram histogram;
+      bound_hash_.AddCosts(&histogram);
+      unbound_hash_.AddCosts(&histogram);
+      double fraction(static_cast<double>(bytes - low_water) /
+        static_cast<double>(bytes));
+      cost_type min_cost(histogram.Threshold(
+        static_cast<unsigned int>(100 * fraction) + 1));
+      evicted_ += bound_hash_.Evict(min_cost) + unbound_hash_.Evict(min_cost);
+      if (bound_hash_.bytes() + unbound_hash_.bytes() <= low_water) {
+        check_interval_ = kCheckInterval;
+        return;
+      }
+      exceeded_ = true;
+      check_interval_ *= 2;
+      next_check_ = inserted_ + check_interval_;
+    }
 
-    // First try without using the first item
-    bool recurse;
-    {  // prepare calc->bound_ for the next item; set recurse if we have one
-      size_type next_item(FirstBound(item + 1));
-      if ((recurse = (next_item != super::size()))) {
-        calc->bound_ = BoundItem(next_item, super::get_count(next_item));
+    // This class is not meant to be copied
+    Memo(const Memo&);
+    Memo& operator=(const Memo&);
+  };
+  typedef Memo<EntryBound, EntryUnbound> DecisionMemo;
+  typedef Memo<EntryValue, EntryValue> ValueMemo;
+
+#ifdef KNAPSACK_THREADS
+  // The hashes shared by several threads: The states are distributed to
+  // kShards independent Memo's (chosen by the upper bits of the hash),
+  // each protected by a mutex and having an own arena.
+  // If decisions is false, only the values are stored (see Calc).
+  class Shared {
+   public:
+    Shared(size_type sacks, std::size_t max_memory, bool decisions)
+      : decisions_(decisions) {
+      for (size_type i(0); i != kShards; ++i) {
+        shard_[i].reset(new Shard(sacks, max_memory / kShards));
       }
     }
-    EntryBound entry(recurse ? SolveBound(calc) : 0);
 
-    // Try with current item at each sack and recurse
-    {  // Use decreased calc->bound_.second for the next recursion if positive
-      count_type count(bound_index.get_count() - 1);
-      if (count > 0) {
-        calc->bound_ = BoundItem(item, count);
-        recurse = true;
-      }  // else: calc->bound_ already refers to the next item
+    bool FindUnbound(const WeightSet& state, EntryUnbound *entry) {
+      Shard& shard = Get(state.get_hash());
+      std::lock_guard<std::mutex> lock(shard.mutex_);
+      return (decisions_ ?
+        (shard.memo_.FindUnbound(state, entry) != KNAPSACK_NULLPTR) :
+        (shard.values_.FindUnbound(state, entry) != KNAPSACK_NULLPTR));
     }
-    weight_type weight(weight_[item]);
-    value_type value(get_value(item));
-    for (size_type sack(super::sack_size() - 1); ; --sack) {
-      weight_type sackmax(calc->SackMax(sack));
-      if (weight <= sackmax) {
-        if (!recurse) {  // This is the last item which can be inserted
-          entry.Select(sack, value);
-          break;  // All sacks for the last item are equally good: break loop
-        }
-        calc->DecreaseTo(sack, sackmax - weight);
-        value_type new_value(SolveBound(calc) + value);
-        calc->IncreaseTo(sack, sackmax);
-        if (new_value > entry.get_value()) {
-          entry.Select(sack, new_value);
-        }
-      }
-      if (sack == 0) {
-        break;
-      }
+
+    bool FindBound(std::size_t hash, const BoundItem& bound,
+        const WeightSet& state, EntryBound *entry) {
+      Shard& shard = Get(hash);
+      std::lock_guard<std::mutex> lock(shard.mutex_);
+      return (decisions_ ?
+        (shard.memo_.FindBound(hash, bound, state, entry) != KNAPSACK_NULLPTR) :
+        (shard.values_.FindBound(hash, bound, state, entry) !=
+        KNAPSACK_NULLPTR));
     }
 
-    // restore data which we possibly changed for recursion
-    calc->bound_ = bound_index.get_bound();
+    void InsertUnbound(const WeightSet& state, const EntryUnbound& entry,
+        typename DecisionMemo::cost_type cost) {
+      Shard& shard = Get(state.get_hash());
+      std::lock_guard<std::mutex> lock(shard.mutex_);
+      if (decisions_) {
+        shard.memo_.InsertUnbound(state, entry, cost);
+      } else {
+        shard.values_.InsertUnbound(state, entry, cost);
+      }
+    }
 
-    // Cache result
-    hash[bound_index] = entry;
-    return entry.get_value();
-  }
+    void InsertBound(std::size_t hash, const BoundItem& bound,
+        const WeightSet& state, const EntryBound& entry,
+        typename DecisionMemo::cost_type cost) {
+      Shard& shard = Get(hash);
+      std::lock_guard<std::mutex> lock(shard.mutex_);
+      if (decisions_) {
+        shard.memo_.InsertBound(hash, bound, state, entry, cost);
+      } else {
+        shard.values_.InsertBound(hash, bound, state, entry, cost);
+      }
+    }
 
- public:
-  typedef std::map<size_type, count_type> SackContent;
-  typedef std::vector<SackContent> SackList;
+    // Add all entries to file; only to be called when no other thread is
+    // running (as evicted())
+    void SaveTo(MemoFile *file) const {
+      for (size_type i(0); i != kShards; ++i) {
+        if (decisions_) {
+          shard_[i]->memo_.SaveTo(file);
+        } else {
+          shard_[i]->values_.SaveTo(file);
+        }
+      }
+    }
 
-  value_type Solve(SackList *sack_list = 0) const {
-    if (sack_list) {
-      *sack_list = SackList(super::sack_size(), SackContent());
+    // Only to be called when no other thread is running
+    void CountBytes(KnapsackStats *stats) const {
+      for (size_type i(0); i != kShards; ++i) {
+        shard_[i]->memo_.CountBytes(stats);
+        shard_[i]->values_.CountBytes(stats);
+      }
     }
-    if (super::empty() || super::sack_empty()) {
-      return 0;
+
+    // This locks each shard in turn
+    void CountEntries(KnapsackProgressInfo *info) {
+      for (size_type i(0); i != kShards; ++i) {
+        std::lock_guard<std::mutex> lock(shard_[i]->mutex_);
+        shard_[i]->memo_.CountEntries(info);
+        shard_[i]->values_.CountEntries(info);
+      }
     }
-    Calc calc(knapsack_);
-    {
-      size_type item(FirstBound(0));
-      if (item != super::size()) {
-        calc.SetBound(item, super::get_count(item));
+
+    std::size_t evicted() const {
+      std::size_t result(0);
+      for (size_type i(0); i != kShards; ++i) {
+        result += shard_[i]->memo_.evicted_ + shard_[i]->values_.evicted_;
       }
+      return result;
     }
-    value_type result(SolveUnbound(&calc));
-    if (sack_list) {
-      typename Calc::BoundHash::const_iterator
-        bound_end(calc.bound_hash_.end());
-      typename Calc::UnboundHash::const_iterator
-        unbound_end(calc.unbound_hash_.end());
-      bool have_bound(calc.have_bound_);
-      BoundItem bound(calc.bound_);
-      // bound and unbound items might be wildly mixed in the hashes:
-      // We start with all unbound (since this is likely the first) as long as
-      // we find, then all bound as long as we find, then again all unbound
-      // (unless bound found nothing), then all bound (starting with next item
-      // if unbound found nothing), etc.
-      for (bool found_bound(true), found_unbound(true); ;
-        found_unbound = false) {
-        if (found_bound) {  // bound search succeeded or we are in first round
-          for (;;) {  // search/update according to unbound_hash
-            typename Calc::UnboundHash::const_iterator
-              found(calc.unbound_hash_.find(calc.sack_set_));
-            if ((found == unbound_end) || !found->second.IsSelected()) {
-              break;
-            }
-            found_unbound = true;
-            const EntryUnbound& entry = found->second;
-            size_type item(entry.get_item());
-            size_type sack(entry.get_sack());
-            ++(*sack_list)[sack][item];
-            calc.DecreaseBy(sack, weight_[item]);
-          }
-        }
-        if (!have_bound) {
-          break;
-        }
-        if (!found_unbound) {  // unbound search failed and not in first round
-          // Pass to next item
-          size_type i(FirstBound(bound.first + 1));
-          if (i == super::size()) {  // search for bound items is finished
-            break;
-          }
-          bound = BoundItem(i, super::get_count(i));
-        }
-        found_bound = false;
-        for (;;) {  // search/update according to bound_hash
-          typename Calc::BoundHash::const_iterator found(
-            calc.bound_hash_.find(BoundIndex(bound, calc.sack_set_)));
-          if ((found == bound_end) || !found->second.IsSelected()) {
-            break;
-          }
-          found_bound = true;
-          size_type item(bound.first);
-          size_type sack(found->second.get_sack());
-          ++(*sack_list)[sack][item];
-          calc.DecreaseBy(sack, weight_[item]);
-          if (--bound.second == 0) {  // Update bound resources
-            size_type i(FirstBound(bound.first + 1));
-            if (i == super::size()) {  // search for bound items is finished
-              have_bound = false;  // still retry once unbound items
-              break;
-            }
-            bound = BoundItem(i, super::get_count(i));
-          }
+
+    bool exceeded() const {
+      for (size_type i(0); i != kShards; ++i) {
+        if (shard_[i]->memo_.exceeded_ || shard_[i]->values_.exceeded_) {
+          return true;
         }
       }
+      return false;
+    }
+
+   private:
+    static const unsigned int kShardBits = 6;
+    static const size_type kShards = (size_type(1) << kShardBits);
+
+    class Shard {
+     public:
+      std::mutex mutex_;
+      KnapsackArena arena_;
+      DecisionMemo memo_;
+      ValueMemo values_;
+
+      Shard(size_type sacks, std::size_t max_memory)
+        : memo_(sacks, max_memory, Allocator(&arena_)),
+        values_(sacks, max_memory, Allocator(&arena_)) {
+      }
+    };
+
+    bool decisions_;
+
+    std::unique_ptr<Shard> shard_[kShards];
+
+    Shard& Get(std::size_t hash) {
+      return *shard_[hash >> (8 * sizeof(std::size_t) - kShardBits)];
+    }
+  };
+#endif
+
+  // A frame of the explicit stack used instead of recursion (see Run()):
+  // the state of a call of SolveUnbound() or SolveBound()
+  class Frame {
+   public:
+    enum Step {
+      kStart,  // nothing was done yet
+      kFirst,  // waiting for the value without placing an item
+      kPlace   // waiting for the value after placing item_ at position pos_
+    };
+
+    bool unbound_;
+    bool decide_;  // do not use or store the hash entry of this state
+    Step step_;
+    bool recurse_;  // only for SolveBound()
+    std::size_t start_;  // the value of calc->computed_ when started
+    std::size_t hash_;  // only for SolveBound()
+    BoundItem bound_;  // only for SolveBound(): calc->bound_ when started
+    size_type item_;  // only for SolveUnbound(): the current item
+    size_type sack_;  // the current sack (index)
+    size_type pos_;  // the position of the current sack before placing
+    weight_type sackmax_;  // the residual capacity before placing
+    value_type value_;  // the value of the current item
+    EntryUnbound unbound_entry_;
+    EntryBound bound_entry_;
+
+    Frame(bool unbound, bool decide)
+      : unbound_(unbound), decide_(decide), step_(kStart), recurse_(false) {
+    }
+  };
+  typedef std::vector<Frame,
+    typename Allocator::template rebind<Frame>::other> FrameList;
+
+  // A class containing all data needed only temporarily for calculation
+  class Calc {
+   public:
+    typedef typename Knapsack<Weight, Value, Count, Allocator>::WeightSet
+      WeightSet;
+    typedef typename KnapsackWeight<Weight, Count>::size_type size_type;
+    typedef typename KnapsackWeight<Weight, Count>::count_type count_type;
+    typedef typename KnapsackWeight<Weight, Count>::WeightList WeightList;
+
+    typedef typename DecisionMemo::cost_type cost_type;
+
+    WeightSet sack_set_;
+
+    // The hashes: If decisions_ is false, only the values of the states are
+    // needed, and values_ is used instead of memo_.
+    DecisionMemo memo_;
+    ValueMemo values_;
+    bool decisions_;
+
+    bool have_bound_;
+    BoundItem bound_;
+
+    // The number of states calculated so far; the difference of this
+    // number before and after a state was calculated is its cost
+    std::size_t computed_;
+
+    // The hash entry of the state of the frame which finished last
+    // (0 if it is unknown, e.g. if shared_ is used)
+    const void *found_;
+
+    // If nonzero, the limit of the calculation (see Poll())
+    const KnapsackDeadline *deadline_;
+
+    // If nonzero, progress is reported when requested (see Poll())
+    const KnapsackReporter *reporter_;
+
+    // If nonzero, the states of this file are used (see FindUnbound()),
+    // and loaded_ is the number of states taken from it. Entries whose
+    // successor was taken from the file do not refer to it.
+    const MemoFile *file_;
+    std::size_t loaded_;
+
+    // False if entries were moved or lost by an earlier calculation with
+    // the same hashes (see Reset())
+    bool follows_;
+
+    // The statistics of the lookups, insertions, and depth
+    KnapsackStats *stats_;
+
+#ifdef KNAPSACK_THREADS
+    // If nonzero, these hashes are used instead of memo_
+    Shared *shared_;
+#endif
+
+   private:
+    typedef std::vector<size_type,
+      typename Allocator::template rebind<size_type>::other> IndexList;
+
+    // The knapsacks are sorted by their residual capacities and then by
+    // their index. sack_[pos] is the index of the knapsack at position pos
+    // of sack_set_, and position_ is the inverse of this permutation.
+    IndexList sack_, position_;
+
+    // The result of Canonical() if it differs from sack_set_
+    WeightSet canonical_;
+
+   public:
+    // If nonempty, the items sorted by decreasing value per weight;
+    // this is used for the upper bounds when pruning
+    IndexList density_;
+
+    // The limits for the states in the hashes (see Canonical()): For a bound
+    // item i, bound_low_[i] is the smallest weight of the bound items from
+    // i on, and bound_total_[i] is the total weight of all copies of the
+    // bound items after i. unbound_low_ and unbound_high_ are the limits
+    // for the states of SolveUnbound().
+    std::vector<weight_type,
+      typename Allocator::template rebind<weight_type>::other> bound_low_;
+    std::vector<long double,
+      typename Allocator::template rebind<long double>::other> bound_total_;
+    weight_type unbound_low_;
+    long double unbound_high_;
+
+    // The explicit stack of the calculation
+    FrameList stack_;
+
+   private:
+    // The number of calls of Poll()
+    std::size_t polls_;
+
+    // The key of the last state looked up in file_
+    typename MemoFile::Key file_key_;
+
+   public:
+    // If nonzero, the hashes store a bound item by reverse_ - 1 - item
+    // instead of its index (see Header() and Session)
+    size_type reverse_;
+
+    // The header of the hash entries of the bound state of bound
+    BoundItem Header(const BoundItem& bound) const {
+      return ((reverse_ == 0) ? bound :
+        BoundItem(reverse_ - 1 - bound.first, bound.second));
+    }
+
+   private:
+
+    // The ordering for WeightSet::Replace() when sack moving_ is changed
+    class Order {
+     public:
+      Order(IndexList *sack, IndexList *position, size_type moving)
+        : sack_(sack), position_(position), moving_(moving) {
+      }
+
+      bool Before(size_type pos, weight_type weight, weight_type value) const {
+        return ((weight < value) ||
+          ((weight == value) && ((*sack_)[pos] < moving_)));
+      }
+
+      void Moved(size_type from, size_type to) {
+        size_type sack((*sack_)[from]);
+        (*sack_)[to] = sack;
+        (*position_)[sack] = to;
+      }
+
+     private:
+      IndexList *sack_, *position_;
+      size_type moving_;
+    };
+
+    class Compare {
+     public:
+      explicit Compare(const WeightList& weight_list)
+        : weight_list_(weight_list) {
+      }
+
+      bool operator()(size_type a, size_type b) const {
+        return ((weight_list_[a] < weight_list_[b]) ||
+          ((weight_list_[a] == weight_list_[b]) && (a < b)));
+      }
+
+     private:
+      const WeightList& weight_list_;
+    };
+
+    static const cost_type kMaxCost = 0xFFFFFFFFU;
+    static const std::size_t kPollSteps = 1024;
+
+    // This class is only meant to be used statically:
+    Calc() {}
+    Calc(const Calc&) {}
+    Calc& operator=(const Calc&) {}
+
+   public:
+    Calc(const WeightList& weight_list, std::size_t max_memory,
+        bool decisions, const Allocator& allocator)
+      : sack_set_(allocator), memo_(weight_list.size(), max_memory, allocator),
+      values_(weight_list.size(), max_memory, allocator),
+      decisions_(decisions), have_bound_(false),
+      computed_(0), found_(KNAPSACK_NULLPTR), deadline_(KNAPSACK_NULLPTR),
+      reporter_(KNAPSACK_NULLPTR), file_(KNAPSACK_NULLPTR), loaded_(0),
+      follows_(true), stats_(KNAPSACK_NULLPTR),
+#ifdef KNAPSACK_THREADS
+      shared_(KNAPSACK_NULLPTR),
+#endif
+      sack_(weight_list.size(), 0, allocator),
+      position_(weight_list.size(), 0, allocator), canonical_(allocator),
+      density_(allocator),
+      bound_low_(allocator), bound_total_(allocator), unbound_low_(0),
+      unbound_high_(0), stack_(allocator), polls_(0), file_key_(allocator),
+      reverse_(0) {
+      Reset(weight_list);
+    }
+
+    // Start a new calculation for the capacities weight_list (of the same
+    // size); the hashes are kept (see Session)
+    void Reset(const WeightList& weight_list) {
+      follows_ = Follows();
+      memo_.evicted_ = values_.evicted_ = 0;
+      memo_.exceeded_ = values_.exceeded_ = false;
+      have_bound_ = false;
+      computed_ = 0;
+      found_ = KNAPSACK_NULLPTR;
+      loaded_ = 0;
+#ifdef KNAPSACK_THREADS
+      shared_ = KNAPSACK_NULLPTR;
+#endif
+      stack_.clear();
+      size_type size(weight_list.size());
+      for (size_type i(0); i != size; ++i) {
+        sack_[i] = i;
+      }
+      std::sort(sack_.begin(), sack_.end(), Compare(weight_list));
+      WeightList sorted(size);
+      for (size_type pos(0); pos != size; ++pos) {
+        size_type sack(sack_[pos]);
+        position_[sack] = pos;
+        sorted[pos] = weight_list[sack];
+      }
+      sack_set_.assign(&sorted[0], &sorted[0] + size);
+    }
+
+    void SetBound(size_type item, count_type count) {
+      bound_ = BoundItem(item, count);
+      have_bound_ = true;
+    }
+
+    // The sum of all residual capacities
+    long double Capacity() const {
+      long double result(0);
+      for (typename WeightSet::const_iterator it(sack_set_.begin());
+        it != sack_set_.end(); ++it) {
+        result += static_cast<long double>(*it);
+      }
+      return result;
+    }
+
+    // The largest residual capacity
+    weight_type CapacityMax() const {
+      return sack_set_[sack_set_.size() - 1];
+    }
+
+    // Throw KnapsackInterrupted if the limit of deadline_ is reached and
+    // report the progress if it is requested; since this needs the clock,
+    // it is checked only every kPollSteps calls
+    void Poll() {
+      if (((deadline_ == KNAPSACK_NULLPTR) &&
+        (reporter_ == KNAPSACK_NULLPTR)) || ((polls_++ % kPollSteps) != 0)) {
+        return;
+      }
+      if (deadline_ != KNAPSACK_NULLPTR) {
+        deadline_->Check();
+      }
+      if ((reporter_ != KNAPSACK_NULLPTR) && reporter_->Requested()) {
+        KnapsackProgressInfo info;
+        info.states_ = computed_;
+        memo_.CountEntries(&info);
+        values_.CountEntries(&info);
+#ifdef KNAPSACK_THREADS
+        if (shared_ != KNAPSACK_NULLPTR) {
+          shared_->CountEntries(&info);
+        }
+#endif
+        reporter_->Report(&info);
+      }
+    }
+
+    // The cost of a state whose calculation started when computed_ was start
+    cost_type Cost(std::size_t start) const {
+      std::size_t cost(computed_ - start);
+      return ((cost < kMaxCost) ? static_cast<cost_type>(cost) : kMaxCost);
+    }
+
+    // The state of the hashes for the current state: Residual capacities
+    // smaller than low (into which no remaining item fits) are replaced
+    // by 0, and those larger than high (the total weight of the remaining
+    // items) by high. This does not change the value of the state, but
+    // more states are found in the hashes. The result is valid until the
+    // next call.
+    const WeightSet& Canonical(weight_type low, long double high) {
+      weight_type top(CapacityMax());
+      if (static_cast<long double>(top) > high) {
+        top = static_cast<weight_type>(high);
+      }
+      return (sack_set_.Clamp(low, top, &canonical_) ? canonical_ :
+        sack_set_);
+    }
+
+    const WeightSet& CanonicalUnbound() {
+      return Canonical(unbound_low_, unbound_high_);
+    }
+
+    // Look up the state key in the hashes and then in file_ and copy the
+    // entry; an entry of file_ selects nothing.
+    // Find and Insert store the address of the entry in found_.
+    bool FindUnbound(const WeightSet& key, EntryUnbound *entry) {
+      if (FindUnboundHash(key, entry)) {
+        stats_->Lookup(true, true);
+        return true;
+      }
+      value_type value;
+      if (!Load(MemoFile::kUnbound, key.get_hash(), KnapsackNoHeader(), key,
+        &value)) {
+        stats_->Lookup(true, false);
+        return false;
+      }
+      stats_->Lookup(true, true);
+      *entry = EntryUnbound(value, KNAPSACK_NULLPTR);
+      return true;
+    }
+
+    bool FindBound(std::size_t hash, const BoundItem& bound,
+        const WeightSet& key, EntryBound *entry) {
+      if (FindBoundHash(hash, bound, key, entry)) {
+        stats_->Lookup(false, true);
+        return true;
+      }
+      value_type value;
+      if (!Load(MemoFile::kBound, hash, bound, key, &value)) {
+        stats_->Lookup(false, false);
+        return false;
+      }
+      stats_->Lookup(false, true);
+      *entry = EntryBound(value, KNAPSACK_NULLPTR);
+      return true;
+    }
+
+  private:
+    bool FindUnboundHash(const WeightSet& key, EntryUnbound *entry) {
+#ifdef KNAPSACK_THREADS
+      if (shared_ != KNAPSACK_NULLPTR) {
+        found_ = KNAPSACK_NULLPTR;
+        return shared_->FindUnbound(key, entry);
+      }
+#endif
+      if (!decisions_) {
+        found_ = KNAPSACK_NULLPTR;
+        return (values_.FindUnbound(key, entry) != KNAPSACK_NULLPTR);
+      }
+      return ((found_ = memo_.FindUnbound(key, entry)) != KNAPSACK_NULLPTR);
+    }
+
+    bool FindBoundHash(std::size_t hash, const BoundItem& bound,
+        const WeightSet& key, EntryBound *entry) {
+#ifdef KNAPSACK_THREADS
+      if (shared_ != KNAPSACK_NULLPTR) {
+        found_ = KNAPSACK_NULLPTR;
+        return shared_->FindBound(hash, bound, key, entry);
+      }
+#endif
+      if (!decisions_) {
+        found_ = KNAPSACK_NULLPTR;
+        return (values_.FindBound(hash, bound, key, entry) != KNAPSACK_NULLPTR);
+      }
+      return ((found_ = memo_.FindBound(hash, bound, key, entry)) !=
+        KNAPSACK_NULLPTR);
+    }
+
+    template <class Header>
+    bool Load(typename MemoFile::Kind kind, std::size_t hash,
+        const Header& header, const WeightSet& key, value_type *value) {
+      if (file_ == KNAPSACK_NULLPTR) {
+        return false;
+      }
+      file_key_.assign(header, key);
+      if (!file_->Find(kind, hash, file_key_, value)) {
+        return false;
+      }
+      ++loaded_;
+      return true;
+    }
+
+  public:
+
+    void InsertUnbound(const WeightSet& key, const EntryUnbound& entry,
+        cost_type cost) {
+      stats_->Insert(true);
+#ifdef KNAPSACK_THREADS
+      if (shared_ != KNAPSACK_NULLPTR) {
+        found_ = KNAPSACK_NULLPTR;
+        shared_->InsertUnbound(key, entry, cost);
+        return;
+      }
+#endif
+      if (!decisions_) {
+        found_ = KNAPSACK_NULLPTR;
+        values_.InsertUnbound(key, entry, cost);
+        return;
+      }
+      found_ = memo_.InsertUnbound(key, entry, cost);
+    }
+
+    void InsertBound(std::size_t hash, const BoundItem& bound,
+        const WeightSet& key, const EntryBound& entry, cost_type cost) {
+      stats_->Insert(false);
+#ifdef KNAPSACK_THREADS
+      if (shared_ != KNAPSACK_NULLPTR) {
+        found_ = KNAPSACK_NULLPTR;
+        shared_->InsertBound(hash, bound, key, entry, cost);
+        return;
+      }
+#endif
+      if (!decisions_) {
+        found_ = KNAPSACK_NULLPTR;
+        values_.InsertBound(hash, bound, key, entry, cost);
+        return;
+      }
+      found_ = memo_.InsertBound(hash, bound, key, entry, cost);
+    }
+
+    // The number of entries evicted due to the memory limit
+    std::size_t evicted() const {
+      return memo_.evicted_ + values_.evicted_;
+    }
+
+    // Whether the memory limit could not be kept (see Memo::CheckMemory())
+    bool exceeded() const {
+      return (memo_.exceeded_ || values_.exceeded_);
+    }
+
+    // Whether all entries of memo_ refer to their successors (see Follow())
+    bool Follows() const {
+      return (follows_ && (evicted() == 0) && (loaded_ == 0));
+    }
+
+    // The number of entries of the hashes
+    std::size_t entries() const {
+      return memo_.size() + values_.size();
+    }
+
+    // Remove the entries which depend on items whose header is at least
+    // first (see Memo::Invalidate()); returns the number of removed entries
+    std::size_t Invalidate(size_type first) {
+      std::size_t removed(memo_.Invalidate(first) +
+        values_.Invalidate(first));
+      if (removed != 0) {
+        follows_ = false;
+      }
+      return removed;
+    }
+
+    // The index of the knapsack at position pos of sack_set_
+    size_type SackAt(size_type pos) const {
+      return sack_[pos];
+    }
+
+    // The position of the knapsack index in sack_set_
+    size_type Position(size_type index) const {
+      return position_[index];
+    }
+
+    // Knapsacks with the same residual capacity are equivalent. We only use
+    // the last one (which has the highest index) of such a group; this
+    // function returns whether pos is not the last one.
+    // The positions (as bits) of the knapsacks into which the placement of
+    // an item is as good as into that at position pos: those with the same
+    // residual capacity and, if Canonical(low, high) replaces that of pos
+    // by high, all those which are replaced by high. For the latter, the
+    // placements lead to states with the same values.
+    // If there are more than kMaxPositions knapsacks or if no decisions are
+    // stored, 0 is returned.
+    boost::uint64_t Equivalent(size_type pos, long double high) const {
+      size_type size(sack_set_.size());
+      if ((size > kMaxPositions) || !decisions_) {
+        return 0;
+      }
+      weight_type weight(sack_set_[pos]);
+      size_type first(pos), last(pos);
+      if (static_cast<long double>(weight) >= high) {
+        last = size - 1;
+        while ((first != 0) &&
+          (static_cast<long double>(sack_set_[first - 1]) >= high)) {
+          --first;
+        }
+      } else {
+        while ((first != 0) && (sack_set_[first - 1] == weight)) {
+          --first;
+        }
+      }
+      // The bits first, ..., last (modulo 2^64 if last is 63)
+      return ((boost::uint64_t(2) << last) - (boost::uint64_t(1) << first));
+    }
+
+    // The positions (as bits) of the knapsacks into which weight fits
+    boost::uint64_t Fitting(weight_type weight) const {
+      size_type size(sack_set_.size());
+      if ((size > kMaxPositions) || !decisions_) {
+        return 0;
+      }
+      size_type first(size);
+      while ((first != 0) && (weight <= sack_set_[first - 1])) {
+        --first;
+      }
+      return ((first == size) ? 0 : ((boost::uint64_t(2) << (size - 1)) -
+        (boost::uint64_t(1) << first)));
+    }
+
+    // The position of the knapsack with the largest index of positions
+    size_type Largest(boost::uint64_t positions) const {
+      size_type result(0), sack(0);
+      bool found(false);
+      for (size_type pos(0); positions != 0; ++pos, positions >>= 1) {
+        if (((positions & 1) != 0) && (!found || (sack_[pos] > sack))) {
+          found = true;
+          result = pos;
+          sack = sack_[pos];
+        }
+      }
+      return result;
+    }
+
+    bool HasSameNext(size_type pos) const {
+      ++pos;
+      return ((pos != sack_set_.size()) &&
+        (sack_set_[pos] == sack_set_[pos - 1]));
+    }
+
+    weight_type SackMax(size_type index) const {
+      return sack_set_[position_[index]];
+    }
+
+    // It is the caller's responsibility to ensure that no underflow occurs
+    void DecreaseBy(size_type index, weight_type subtract) {
+      DecreaseTo(index, static_cast<weight_type>(SackMax(index) - subtract));
+    }
+
+    void DecreaseTo(size_type index, weight_type new_weight) {
+      Order order(&sack_, &position_, index);
+      size_type pos(sack_set_.Replace(position_[index], new_weight, &order));
+      sack_[pos] = index;
+      position_[index] = pos;
+    }
+
+    // A separate function for possibly optimizing a different implementation
+    void IncreaseTo(size_type index, weight_type new_weight) {
+      DecreaseTo(index, new_weight);
+    }
+  };
+
+  // Sorts items by decreasing value per weight, ties by index
+  class Density {
+   public:
+    explicit Density(const Knapsack& knapsack)
+      : knapsack_(knapsack) {
+    }
+
+    bool operator()(size_type a, size_type b) const {
+      long double da(static_cast<long double>(knapsack_.get_value(a)) *
+        static_cast<long double>(knapsack_.weight_[b]));
+      long double db(static_cast<long double>(knapsack_.get_value(b)) *
+        static_cast<long double>(knapsack_.weight_[a]));
+      return ((da > db) || (!(da < db) && (a < b)));
+    }
+
+   private:
+    const Knapsack& knapsack_;
+  };
+
+  // An upper bound (Dantzig's bound of the linear relaxation) for the value
+  // which can be obtained with capacity: If unbound is true, all unbound
+  // items can be used; if calc->have_bound_ is true, the bound items
+  // described by calc->bound_ (and later) can be used.
+  // Items which do not fit into the largest residual capacity are ignored.
+  long double UpperBound(const Calc& calc, bool unbound,
+      long double capacity) const {
+    return Relaxation(&calc.density_[0], calc.density_.size(),
+      calc.CapacityMax(), unbound, calc.have_bound_, calc.bound_, capacity);
+  }
+
+  // The bound of UpperBound() for the size items density[0], ... (sorted by
+  // Density) with the largest residual capacity weight_max
+  long double Relaxation(const size_type *density, size_type size,
+      weight_type weight_max, bool unbound, bool have_bound,
+      const BoundItem& bound, long double capacity) const {
+    long double result(0);
+    for (size_type i(0); i != size; ++i) {
+      size_type item(density[i]);
+      weight_type weight(weight_[item]);
+      if (weight > weight_max) {
+        continue;
+      }
+      long double count;
+      if (!super::IsBound(item)) {
+        if (!unbound) {
+          continue;
+        }
+        count = capacity;  // more than enough
+      } else {
+        if (!have_bound || (item < bound.first)) {
+          continue;
+        }
+        count = static_cast<long double>((item == bound.first) ?
+          bound.second : super::get_count(item));
+      }
+      long double item_weight(static_cast<long double>(weight));
+      long double value(static_cast<long double>(get_value(item)));
+      if (count * item_weight >= capacity) {
+        return result + capacity * value / item_weight;
+      }
+      result += count * value;
+      capacity -= count * item_weight;
+    }
+    return result;
+  }
+
+  // Whether placing item cannot lead to a value larger than best when
+  // capacity is the sum of the residual capacities (see UpperBound()).
+  // Since only a strictly larger value is selected, skipping such
+  // placements does not change the result (up to rounding errors).
+  bool Hopeless(const Calc& calc, bool unbound, long double capacity,
+      size_type item, value_type best) const {
+    long double weight(static_cast<long double>(weight_[item]));
+    return (static_cast<long double>(get_value(item)) +
+      UpperBound(calc, unbound, capacity - weight) <
+      static_cast<long double>(best));
+  }
+
+  // The state of the hashes for the current state of SolveBound() with bound
+  const WeightSet& CanonicalBound(Calc *calc, const BoundItem& bound) const {
+    return calc->Canonical(calc->bound_low_[bound.first],
+      HighBound(*calc, bound));
+  }
+
+  // The total weight of the remaining copies of the bound items
+  long double HighBound(const Calc& calc, const BoundItem& bound) const {
+    size_type item(bound.first);
+    return (static_cast<long double>(bound.second) *
+      static_cast<long double>(weight_[item]) + calc.bound_total_[item]);
+  }
+
+  // Set the limits of calc for Canonical()
+  void SetLimits(Calc *calc) const {
+    size_type size(super::size());
+    calc->bound_low_.assign(size, 0);
+    calc->bound_total_.assign(size, 0);
+    bool have_low(false), have_unbound(false);
+    weight_type low(0);
+    long double total(0);
+    for (size_type item(size); item != 0; ) {
+      --item;
+      weight_type weight(weight_[item]);
+      if (!have_low || (weight < low)) {
+        low = weight;
+      }
+      have_low = true;
+      if (!super::IsBound(item)) {
+        have_unbound = true;
+        continue;
+      }
+      calc->bound_total_[item] = total;
+      total += static_cast<long double>(super::get_count(item)) *
+        static_cast<long double>(weight);
+    }
+    calc->unbound_low_ = low;
+    calc->unbound_high_ = (have_unbound ?
+      std::numeric_limits<long double>::max() : total);
+    low = 0;
+    have_low = false;
+    for (size_type item(size); item != 0; ) {
+      --item;
+      if (super::IsBound(item)) {
+        weight_type weight(weight_[item]);
+        if (!have_low || (weight < low)) {
+          low = weight;
+        }
+        have_low = true;
+        calc->bound_low_[item] = low;
+      }
+    }
+  }
+
+  // Returns the first bound item index starting at item (possibly end of list)
+  size_type FirstBound(size_type item) const {
+    for (; item != super::size() ; ++item) {
+      if (super::IsBound(item)) {
+        return item;
+      }
+    }
+    return item;
+  }
+
+  // Returns max according to calc->sack_set_,
+  // assuming no bound item has been used.
+  // It is assumed that super::size() and super::sack_size() are at least 1
+  value_type SolveUnbound(Calc *calc) const {
+    value_type value(Run(calc, true, false)->unbound_entry_.get_value());
+    calc->stack_.pop_back();
+    return value;
+  }
+
+  // Returns max using only bound items calc->bound_.first or later,
+  // the first item at most calc->bound_.second times,
+  // according to current calc->sack_set_.
+  // It is assumed that super::sack_size() is at least 1, and moreover:
+  // calc->bound_.first must be the index of a bound item, and
+  // calc->bound_.second must be positive
+  value_type SolveBound(Calc *calc) const {
+    value_type value(Run(calc, false, false)->bound_entry_.get_value());
+    calc->stack_.pop_back();
+    return value;
+  }
+
+  // Like SolveUnbound() and SolveBound(), but the entry of the state is
+  // calculated anew from the values of the successor states (which are
+  // usually found in the hashes). In particular, the selected position
+  // refers to the current assignment of the knapsacks to the positions.
+  void DecideUnbound(Calc *calc, EntryUnbound *result) const {
+    *result = Run(calc, true, true)->unbound_entry_;
+    calc->stack_.pop_back();
+  }
+
+  void DecideBound(Calc *calc, EntryBound *result) const {
+    *result = Run(calc, false, true)->bound_entry_;
+    calc->stack_.pop_back();
+  }
+
+  // The calculation uses an explicit stack of frames instead of recursion:
+  // Each frame corresponds to a state of SolveUnbound() or SolveBound().
+  // A frame which needs the value of another state pushes a frame for that
+  // state and continues when that frame is finished.
+  // This function pushes a frame and calculates until it is finished;
+  // the finished frame is returned and must be popped by the caller.
+  Frame *Run(Calc *calc, bool unbound, bool decide) const {
+    FrameList& stack = calc->stack_;
+    size_type bottom(stack.size());
+    stack.push_back(Frame(unbound, decide));
+    value_type value(0);
+    for (;;) {
+      calc->Poll();
+      bool finished(stack.back().unbound_ ?
+        ContinueUnbound(calc, &value) : ContinueBound(calc, &value));
+      if (!finished) {
+        calc->stats_->Depth(stack.size());
+        continue;
+      }
+      if (stack.size() == bottom + 1) {
+        return &stack.back();
+      }
+      stack.pop_back();
+    }
+  }
+
+  // Continue the topmost frame of SolveUnbound(). Returns true if the frame
+  // is finished; then its value is stored in *value. Otherwise, a new frame
+  // was pushed; the value of that frame is passed when continuing.
+  bool ContinueUnbound(Calc *calc, value_type *value) const {
+    Frame *frame(&calc->stack_.back());
+    const WeightSet& sack_set = calc->sack_set_;
+    switch (frame->step_) {
+      case Frame::kStart: {
+        // Return cached result if possible
+        if (!frame->decide_ && calc->FindUnbound(calc->CanonicalUnbound(),
+          &frame->unbound_entry_)) {
+          *value = frame->unbound_entry_.get_value();
+          return true;
+        }
+        frame->start_ = calc->computed_++;
+        frame->item_ = super::size();
+        frame->sack_ = 0;
+
+        // First try without using any item
+        if (calc->have_bound_) {
+          frame->step_ = Frame::kFirst;
+          calc->stack_.push_back(Frame(false, false));
+          return false;
+        }
+        frame->unbound_entry_ = EntryUnbound(0, KNAPSACK_NULLPTR);
+        break;
+      }
+      case Frame::kFirst:
+        frame->unbound_entry_ = EntryUnbound(*value, calc->found_);
+        break;
+      case Frame::kPlace:
+      default: {
+        calc->IncreaseTo(frame->sack_, frame->sackmax_);
+        value_type new_value(*value + frame->value_);
+        EntryUnbound& entry = frame->unbound_entry_;
+        if (new_value > entry.get_value()) {
+          entry.Select(frame->item_, frame->pos_, new_value, calc->found_,
+            calc->Equivalent(frame->pos_, calc->unbound_high_));
+        } else if (!(new_value < entry.get_value()) && entry.IsSelected() &&
+          (entry.get_item() == frame->item_)) {  // the same value
+          entry.AddPositions(calc->Equivalent(frame->pos_,
+            calc->unbound_high_));
+        }
+        break;
+      }
+    }
+
+    // Place each unbound item into each sack and recurse.
+    // Knapsacks with the same residual capacity lead to the same state,
+    // so only the last position of each residual capacity is tried.
+    for (;;) {
+      if (frame->sack_ == 0) {  // Proceed to the next unbound item
+        if (frame->item_ == 0) {
+          break;
+        }
+        size_type item(--(frame->item_));
+        if (super::IsBound(item) || (!calc->density_.empty() &&
+          Hopeless(*calc, true, calc->Capacity(), item,
+            frame->unbound_entry_.get_value()))) {
+          continue;
+        }
+        frame->sack_ = super::sack_size();
+      }
+      size_type sack(--(frame->sack_));
+      size_type pos(calc->Position(sack));
+      weight_type sackmax(sack_set[pos]);
+      weight_type weight(weight_[frame->item_]);
+      if ((weight <= sackmax) && !calc->HasSameNext(pos)) {
+        frame->step_ = Frame::kPlace;
+        frame->pos_ = pos;
+        frame->sackmax_ = sackmax;
+        frame->value_ = get_value(frame->item_);
+        calc->DecreaseTo(sack, sackmax - weight);
+        calc->stack_.push_back(Frame(true, false));
+        return false;
+      }
+    }
+
+    // Cache result
+    calc->found_ = KNAPSACK_NULLPTR;
+    if (!frame->decide_) {
+      calc->InsertUnbound(calc->CanonicalUnbound(), frame->unbound_entry_,
+        calc->Cost(frame->start_));
+    }
+    *value = frame->unbound_entry_.get_value();
+    return true;
+  }
+
+  // Continue the topmost frame of SolveBound(); see ContinueUnbound()
+  bool ContinueBound(Calc *calc, value_type *value) const {
+    Frame *frame(&calc->stack_.back());
+    switch (frame->step_) {
+      case Frame::kStart: {
+        // Return cached result if possible
+        frame->bound_ = calc->bound_;
+        const WeightSet& key = CanonicalBound(calc, frame->bound_);
+        BoundItem header(calc->Header(frame->bound_));
+        frame->hash_ = HashBound(header, key);
+        if (!frame->decide_ && calc->FindBound(frame->hash_, header, key,
+          &frame->bound_entry_)) {
+          *value = frame->bound_entry_.get_value();
+          return true;
+        }
+        frame->start_ = calc->computed_++;
+
+        // First try without using the first item:
+        // prepare calc->bound_ for the next item if we have one
+        size_type next_item(FirstBound(frame->bound_.first + 1));
+        if ((frame->recurse_ = (next_item != super::size()))) {
+          calc->bound_ = BoundItem(next_item, super::get_count(next_item));
+          frame->step_ = Frame::kFirst;
+          calc->stack_.push_back(Frame(false, false));
+          return false;
+        }
+        frame->bound_entry_ = EntryBound(0, KNAPSACK_NULLPTR);
+        StartPlacing(calc, frame);
+        break;
+      }
+      case Frame::kFirst:
+        frame->bound_entry_ = EntryBound(*value, calc->found_);
+        StartPlacing(calc, frame);
+        break;
+      case Frame::kPlace:
+      default: {
+        calc->IncreaseTo(frame->sack_, frame->sackmax_);
+        value_type new_value(*value + frame->value_);
+        EntryBound& entry = frame->bound_entry_;
+        if (new_value > entry.get_value()) {
+          entry.Select(frame->pos_, new_value, calc->found_,
+            calc->Equivalent(frame->pos_, HighBound(*calc, frame->bound_)));
+        } else if (!(new_value < entry.get_value()) &&
+          entry.IsSelected()) {  // the same value
+          entry.AddPositions(calc->Equivalent(frame->pos_,
+            HighBound(*calc, frame->bound_)));
+        }
+        break;
+      }
+    }
+
+    // Try with current item at each sack and recurse
+    const WeightSet& sack_set = calc->sack_set_;
+    weight_type weight(weight_[frame->bound_.first]);
+    while (frame->sack_ != 0) {
+      size_type sack(--(frame->sack_));
+      size_type pos(calc->Position(sack));
+      weight_type sackmax(sack_set[pos]);
+      if ((weight <= sackmax) && !calc->HasSameNext(pos)) {
+        if (!frame->recurse_) {  // This is the last item which can be inserted
+          frame->bound_entry_.Select(pos, frame->value_, KNAPSACK_NULLPTR,
+            calc->Fitting(weight));
+          break;  // All sacks for the last item are equally good: break loop
+        }
+        frame->step_ = Frame::kPlace;
+        frame->pos_ = pos;
+        frame->sackmax_ = sackmax;
+        calc->DecreaseTo(sack, sackmax - weight);
+        calc->stack_.push_back(Frame(false, false));
+        return false;
+      }
+    }
+
+    // restore data which we possibly changed for recursion
+    calc->bound_ = frame->bound_;
+
+    // Cache result
+    calc->found_ = KNAPSACK_NULLPTR;
+    if (!frame->decide_) {
+      calc->InsertBound(frame->hash_, calc->Header(frame->bound_),
+        CanonicalBound(calc, frame->bound_), frame->bound_entry_,
+        calc->Cost(frame->start_));
+    }
+    *value = frame->bound_entry_.get_value();
+    return true;
+  }
+
+  // Prepare the frame of SolveBound() for placing the current item
+  void StartPlacing(Calc *calc, Frame *frame) const {
+    size_type item(frame->bound_.first);
+    frame->value_ = get_value(item);
+    frame->sack_ = super::sack_size();
+
+    // Use decreased calc->bound_.second for the next recursion if positive
+    count_type count(frame->bound_.second - 1);
+    if (count > 0) {
+      calc->bound_ = BoundItem(item, count);
+      frame->recurse_ = true;
+    }  // else: calc->bound_ already refers to the next item
+
+    // Skip placing if this is hopeless (only when pruning)
+    if (frame->recurse_ && !calc->density_.empty() &&
+      Hopeless(*calc, false, calc->Capacity(), item,
+        frame->bound_entry_.get_value())) {
+      frame->sack_ = 0;
+    }
+  }
+
+#ifdef KNAPSACK_THREADS
+  typedef typename super::WeightList WeightList;
+
+  // A state of the calculation (with knapsacks by index) for a thread
+  class Task {
+   public:
+    WeightList sack_;
+    bool unbound_, have_bound_;
+    BoundItem bound_;
+
+    Task(const WeightList& sack, bool unbound, bool have_bound,
+        const BoundItem& bound)
+      : sack_(sack), unbound_(unbound), have_bound_(have_bound),
+      bound_(bound) {
+    }
+
+    // The data which distinguishes the states
+    typedef std::pair<std::pair<WeightList, BoundItem>, int> Key;
+
+    Key GetKey() const {
+      WeightList sorted(sack_);
+      std::sort(sorted.begin(), sorted.end());
+      return Key(std::make_pair(sorted, have_bound_ ? bound_ : BoundItem()),
+        (unbound_ ? 2 : 0) + (have_bound_ ? 1 : 0));
+    }
+  };
+  typedef std::vector<Task> TaskList;
+
+  // Append the successor states of task to tasks unless they are in seen
+  void Expand(const Task& task, TaskList *tasks,
+      std::set<typename Task::Key> *seen) const {
+    TaskList next;
+    size_type next_item(super::size());
+    if (task.unbound_) {
+      if (task.have_bound_) {
+        next.push_back(Task(task.sack_, false, true, task.bound_));
+      }
+      for (size_type item(0); item != super::size(); ++item) {
+        if (!super::IsBound(item)) {
+          Place(task, item, true, task.have_bound_, task.bound_, &next);
+        }
+      }
+    } else {
+      size_type item(task.bound_.first);
+      next_item = FirstBound(item + 1);
+      BoundItem bound(next_item, 0);
+      if (next_item != super::size()) {
+        bound.second = super::get_count(next_item);
+        next.push_back(Task(task.sack_, false, true, bound));
+      }
+      if (task.bound_.second > 1) {
+        Place(task, item, false, true,
+          BoundItem(item, task.bound_.second - 1), &next);
+      } else if (next_item != super::size()) {
+        Place(task, item, false, true, bound, &next);
+      }
+    }
+    for (typename TaskList::const_iterator it(next.begin());
+      it != next.end(); ++it) {
+      if (seen->insert(it->GetKey()).second) {
+        tasks->push_back(*it);
+      }
+    }
+  }
+
+  // Append the states obtained by placing item into each knapsack of task
+  void Place(const Task& task, size_type item, bool unbound, bool have_bound,
+      const BoundItem& bound, TaskList *tasks) const {
+    weight_type weight(weight_[item]);
+    for (size_type sack(0); sack != task.sack_.size(); ++sack) {
+      if (weight <= task.sack_[sack]) {
+        Task placed(task.sack_, unbound, have_bound, bound);
+        placed.sack_[sack] -= weight;
+        tasks->push_back(placed);
+      }
+    }
+  }
+
+  // The states of the first level of the calculation from calc which has
+  // at least count states (or of the last level)
+  TaskList Split(const Calc& calc, size_type count) const {
+    WeightList sack(super::sack_size());
+    for (size_type i(0); i != sack.size(); ++i) {
+      sack[i] = calc.SackMax(i);
+    }
+    TaskList level(1, Task(sack, true, calc.have_bound_, calc.bound_));
+    for (unsigned int depth(0); (depth != kSplitDepth) &&
+      (level.size() < count); ++depth) {
+      TaskList next;
+      std::set<typename Task::Key> seen;
+      for (typename TaskList::const_iterator it(level.begin());
+        it != level.end(); ++it) {
+        Expand(*it, &next, &seen);
+      }
+      if (next.empty()) {
+        break;
+      }
+      level.swap(next);
+    }
+    return level;
+  }
+
+  static const unsigned int kSplitDepth = 64;
+  static const size_type kTasksPerThread = 16;
+
+  // Calculate tasks with threads_ threads (including the current one) and
+  // store the results in shared. Each thread takes the next task which is
+  // not yet taken; the states calculated by one thread are used by others.
+  void Prefetch(const Calc& calc, Shared *shared) const {
+    TaskList tasks(Split(calc, kTasksPerThread * threads_));
+    std::atomic<size_type> next(0);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    std::vector<std::thread> thread;
+    for (unsigned int i(1); i < threads_; ++i) {
+      thread.push_back(std::thread(&Knapsack::Work, this, &calc, shared,
+        &tasks, &next, &error, &error_mutex, false));
+    }
+    Work(&calc, shared, &tasks, &next, &error, &error_mutex, true);
+    for (typename std::vector<std::thread>::iterator it(thread.begin());
+      it != thread.end(); ++it) {
+      it->join();
+    }
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  // The function of a thread of Prefetch(); only the calling thread
+  // reports the progress
+  void Work(const Calc *root, Shared *shared, const TaskList *tasks,
+      std::atomic<size_type> *next, std::exception_ptr *error,
+      std::mutex *error_mutex, bool calling) const {
+    KnapsackStats stats;
+    try {
+      KnapsackArena arena;
+      Calc calc(knapsack_, 0, root->decisions_, Allocator(&arena));
+      calc.density_.assign(root->density_.begin(), root->density_.end());
+      SetLimits(&calc);
+      calc.deadline_ = root->deadline_;
+      if (calling) {
+        calc.reporter_ = root->reporter_;
+      }
+      calc.file_ = root->file_;
+      calc.reverse_ = root->reverse_;
+      calc.stats_ = &stats;
+      calc.shared_ = shared;
+      for (size_type index; (index = (*next)++) < tasks->size(); ) {
+        const Task& task = (*tasks)[index];
+        for (size_type sack(0); sack != task.sack_.size(); ++sack) {
+          calc.DecreaseTo(sack, task.sack_[sack]);
+        }
+        calc.have_bound_ = task.have_bound_;
+        calc.bound_ = task.bound_;
+        if (task.unbound_) {
+          SolveUnbound(&calc);
+        } else {
+          SolveBound(&calc);
+        }
+      }
+    } catch(...) {
+      *next = tasks->size();  // let the other threads finish
+      std::lock_guard<std::mutex> lock(*error_mutex);
+      if (!*error) {
+        *error = std::current_exception();
+      }
+    }
+    std::lock_guard<std::mutex> lock(*error_mutex);  // also for stats
+    root->stats_->Add(stats);
+  }
+#endif
+
+ public:
+  typedef std::map<size_type, count_type> SackContent;
+  typedef std::vector<SackContent> SackList;
+
+ private:
+  typedef KnapsackDense<value_type, Allocator> Dense;
+  typedef KnapsackSubsetSum<Allocator> SubsetSum;
+
+  static const std::size_t kDenseMemory = (std::size_t(1) << 28);
+  static const unsigned int kDenseWorkBits = 32;
+  static const unsigned int kDenseFactor = 64;
+
+  // The number of copies of item which can be placed into the knapsacks
+  // (at most its count): More copies lead to the same states.
+  size_type DenseCount(size_type item) const {
+    weight_type weight(weight_[item]);
+    size_type result(0);
+    for (size_type i(0); i != super::sack_size(); ++i) {
+      result += static_cast<size_type>(knapsack_[i] / weight);
+    }
+    count_type count(super::get_count(item));
+    if (static_cast<long double>(count) < static_cast<long double>(result)) {
+      return static_cast<size_type>(count);
+    }
+    return result;
+  }
+
+  // Whether the value of each item is its weight
+  bool AllValueIsWeight() const {
+    for (size_type item(0); item != super::size(); ++item) {
+      if (!ValueIsWeight(item)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // The engine used by Solve() (see set_engine()): The work of the dense
+  // engine is the number of states times the number of layers (the bitset
+  // engine processes 64 states at once); the hash engine needs more time
+  // per state, but for bound items it calculates at most one state for
+  // each subset of the items.
+  typename super::Engine SelectEngine() const {
+    size_type sacks(super::sack_size());
+    if ((engine_ == super::kEngineHash) || (sacks > 2) ||
+      !std::numeric_limits<weight_type>::is_integer) {
+      return super::kEngineHash;
+    }
+    long double rows((sacks == 2) ?
+      (static_cast<long double>(knapsack_[0]) + 1) : 1);
+    long double width(static_cast<long double>(knapsack_[sacks - 1]) + 1);
+    long double cells(rows * width);
+    if (cells >= static_cast<long double>(
+      std::numeric_limits<size_type>::max() / 2)) {
+      return super::kEngineHash;
+    }
+    bool bitset(AllValueIsWeight());
+    if (engine_ == super::kEngineDense) {
+      return super::kEngineDense;
+    }
+    if (engine_ == super::kEngineBitset) {
+      return (bitset ? super::kEngineBitset : super::kEngineHash);
+    }
+    long double layers(1), subsets(1);
+    bool unbound(false);
+    for (size_type item(0); item != super::size(); ++item) {
+      if (!super::IsBound(item)) {
+        unbound = true;
+        layers += 1;
+        continue;
+      }
+      long double count(static_cast<long double>(DenseCount(item)));
+      layers += count;
+      subsets *= count + 1;
+    }
+    std::size_t memory((max_memory_ != 0) ? max_memory_ : kDenseMemory);
+    long double bytes, work;
+    if (bitset) {
+      bytes = SubsetSum::Bytes(static_cast<size_type>(rows),
+        static_cast<size_type>(width), static_cast<size_type>(layers));
+      work = cells * layers / 64;
+    } else {
+      bytes = Dense::Bytes(static_cast<size_type>(rows),
+        static_cast<size_type>(width), static_cast<size_type>(layers));
+      work = cells * layers;
+    }
+    if ((bytes <= static_cast<long double>(memory)) &&
+      (work <= static_cast<long double>(std::size_t(1) << kDenseWorkBits)) &&
+      (unbound || (work <= kDenseFactor * subsets))) {
+      return (bitset ? super::kEngineBitset : super::kEngineDense);
+    }
+    return super::kEngineHash;
+  }
+
+  // Solve() with the dense engine: The first knapsack of the dense engine
+  // is the knapsack with index 0, the last one that with the highest index.
+  value_type SolveDense(SackList *sack_list,
+      const KnapsackDeadline *deadline) const {
+    KnapsackStats::Timer timer(&stats_.search_seconds_);
+    size_type sacks(super::sack_size());
+    size_type rows((sacks == 2) ?
+      (static_cast<size_type>(knapsack_[0]) + 1) : 1);
+    size_type width(static_cast<size_type>(knapsack_[sacks - 1]) + 1);
+    weight_type weight_max(knapsack_[0]);
+    if (weight_max < knapsack_[sacks - 1]) {
+      weight_max = knapsack_[sacks - 1];
+    }
+    Allocator allocator(&arena_);
+    Dense dense(rows, width, allocator);
+    typedef std::vector<size_type,
+      typename Allocator::template rebind<size_type>::other> IndexList;
+    typedef std::vector<value_type,
+      typename Allocator::template rebind<value_type>::other> DenseValueList;
+    IndexList layer(super::size(), 0, allocator),
+      count(super::size(), 0, allocator);
+    for (size_type item(super::size()); item != 0; ) {
+      --item;
+      if (deadline != KNAPSACK_NULLPTR) {
+        deadline->Check();
+      }
+      if (super::IsBound(item) && ((count[item] = DenseCount(item)) != 0)) {
+        layer[item] = dense.AddBound(static_cast<size_type>(weight_[item]),
+          get_value(item), count[item]);
+      }
+    }
+    IndexList unbound_item(allocator), unbound_weight(allocator);
+    DenseValueList unbound_value(allocator);
+    for (size_type item(super::size()); item != 0; ) {
+      --item;
+      if (!super::IsBound(item) && (weight_[item] <= weight_max)) {
+        unbound_item.push_back(item);
+        unbound_weight.push_back(static_cast<size_type>(weight_[item]));
+        unbound_value.push_back(get_value(item));
+      }
+    }
+    if (!unbound_item.empty()) {
+      dense.AddUnbound(&unbound_weight[0], &unbound_value[0],
+        unbound_item.size());
+    }
+    size_type first(rows - 1), last(width - 1);
+    value_type result(dense.get_value(dense.Cell(first, last)));
+    if (!sack_list) {
+      return result;
+    }
+    // Follow the decisions as in Solve()
+    for (;;) {
+      typename Dense::Decision decision;
+      size_type index(dense.DecideUnbound(first, last, &decision));
+      if (index == unbound_item.size()) {
+        break;
+      }
+      DensePlace(unbound_item[index], decision, &first, &last, sack_list);
+    }
+    for (size_type item(FirstBound(0)); item != super::size();
+      item = FirstBound(item + 1)) {
+      for (size_type c(count[item]); c != 0; --c) {
+        typename Dense::Decision decision(dense.DecideBound(layer[item] + c - 1,
+          dense.Cell(first, last)));
+        if (decision == Dense::kSkip) {
+          break;
+        }
+        DensePlace(item, decision, &first, &last, sack_list);
+      }
+    }
+    return result;
+  }
+
+  // Solve() with the bitset engine; the decisions are made as for the dense
+  // engine from the largest sums of the layers
+  value_type SolveSubsetSum(SackList *sack_list,
+      const KnapsackDeadline *deadline) const {
+    KnapsackStats::Timer timer(&stats_.search_seconds_);
+    size_type sacks(super::sack_size());
+    size_type rows((sacks == 2) ?
+      (static_cast<size_type>(knapsack_[0]) + 1) : 1);
+    size_type width(static_cast<size_type>(knapsack_[sacks - 1]) + 1);
+    weight_type weight_max(knapsack_[0]);
+    if (weight_max < knapsack_[sacks - 1]) {
+      weight_max = knapsack_[sacks - 1];
+    }
+    Allocator allocator(&arena_);
+    typedef std::vector<size_type,
+      typename Allocator::template rebind<size_type>::other> IndexList;
+    IndexList layer(super::size(), 0, allocator),
+      count(super::size(), 0, allocator);
+    size_type layers(1);
+    for (size_type item(0); item != super::size(); ++item) {
+      if (super::IsBound(item)) {
+        layers += (count[item] = DenseCount(item));
+      }
+    }
+    SubsetSum subset_sum(rows, width, layers, allocator);
+    for (size_type item(super::size()); item != 0; ) {
+      --item;
+      if (deadline != KNAPSACK_NULLPTR) {
+        deadline->Check();
+      }
+      if (count[item] != 0) {
+        layer[item] = subset_sum.AddBound(
+          static_cast<size_type>(weight_[item]), count[item]);
+      }
+    }
+    size_type bound_layer(subset_sum.get_layer());
+    IndexList unbound_item(allocator), unbound_weight(allocator);
+    for (size_type item(super::size()); item != 0; ) {
+      --item;
+      if (!super::IsBound(item) && (weight_[item] <= weight_max)) {
+        unbound_item.push_back(item);
+        unbound_weight.push_back(static_cast<size_type>(weight_[item]));
+      }
+    }
+    size_type unbound_layer(bound_layer);
+    if (!unbound_item.empty()) {
+      unbound_layer = subset_sum.AddUnbound(&unbound_weight[0],
+        unbound_weight.size());
+    }
+    size_type first(rows - 1), last(width - 1);
+    value_type result(static_cast<value_type>(
+      subset_sum.Best(unbound_layer, first, last)));
+    if (!sack_list) {
+      return result;
+    }
+    // Follow the decisions as in SolveDense()
+    for (;;) {
+      size_type best(subset_sum.Best(bound_layer, first, last));
+      typename Dense::Decision decision(Dense::kSkip);
+      size_type index(unbound_item.size());
+      for (size_type i(0); i != unbound_item.size(); ++i) {
+        if (SubsetSumDecide(subset_sum, unbound_layer, unbound_weight[i],
+          first, last, &best, &decision)) {
+          index = i;
+        }
+      }
+      if (index == unbound_item.size()) {
+        break;
+      }
+      DensePlace(unbound_item[index], decision, &first, &last, sack_list);
+    }
+    for (size_type item(FirstBound(0)); item != super::size();
+      item = FirstBound(item + 1)) {
+      for (size_type c(count[item]); c != 0; --c) {
+        // The layer for count c - 1 (and layer[item] - 1 for count 0)
+        size_type previous(layer[item] + c - 2);
+        size_type best(subset_sum.Best(layer[item] - 1, first, last));
+        typename Dense::Decision decision(Dense::kSkip);
+        SubsetSumDecide(subset_sum, previous,
+          static_cast<size_type>(weight_[item]), first, last, &best,
+          &decision);
+        if (decision == Dense::kSkip) {
+          break;
+        }
+        DensePlace(item, decision, &first, &last, sack_list);
+      }
+    }
+    return result;
+  }
+
+  // Update *best and *decision if placing an item of weight into the last
+  // or first knapsack gives a larger sum, using the sums of layer.
+  // Returns whether an update happened.
+  static bool SubsetSumDecide(const SubsetSum& subset_sum, size_type layer,
+      size_type weight, size_type first, size_type last, size_type *best,
+      typename Dense::Decision *decision) {
+    bool result(false);
+    if (weight <= last) {
+      size_type placed(subset_sum.Best(layer, first, last - weight) + weight);
+      if (placed > *best) {
+        *best = placed;
+        *decision = Dense::kLast;
+        result = true;
+      }
+    }
+    if ((weight <= first) && (first != last)) {
+      size_type placed(subset_sum.Best(layer, first - weight, last) + weight);
+      if (placed > *best) {
+        *best = placed;
+        *decision = Dense::kFirst;
+        result = true;
+      }
+    }
+    return result;
+  }
+
+  void DensePlace(size_type item, typename Dense::Decision decision,
+      size_type *first, size_type *last, SackList *sack_list) const {
+    size_type weight(static_cast<size_type>(weight_[item]));
+    if (decision == Dense::kFirst) {
+      ++(*sack_list)[0][item];
+      *first -= weight;
+    } else {
+      ++(*sack_list)[super::sack_size() - 1][item];
+      *last -= weight;
+    }
+  }
+
+  // The original items of an item of a preprocessed instance; one copy of
+  // the item corresponds to multiple_ copies of the original items
+  class Origin {
+   public:
+    std::vector<size_type> items_;
+    count_type multiple_;
+
+    Origin(const std::vector<size_type>& items, count_type multiple)
+      : items_(items), multiple_(multiple) {
+    }
+  };
+  typedef std::vector<Origin> OriginList;
+
+  // Exchange the arenas of two Knapsack objects while the object exists
+  class ArenaSwap {
+   public:
+    ArenaSwap(KnapsackArena *arena, KnapsackArena *other)
+      : arena_(arena), other_(other) {
+      arena_->swap(*other_);
+    }
+
+    ~ArenaSwap() {
+      arena_->swap(*other_);
+    }
+
+   private:
+    KnapsackArena *arena_, *other_;
+  };
+
+  // Store the simplified instance (see set_preprocess() and set_bundle())
+  // in *reduced and the original items of each of its items in *origin;
+  // the values of *reduced are smaller by the factor *scale.
+  // Returns false if nothing is simplified.
+  bool Preprocess(Knapsack *reduced, OriginList *origin,
+      value_type *scale) const {
+    size_type size(super::size());
+    weight_type weight_max(0);
+    for (size_type i(0); i != super::sack_size(); ++i) {
+      if (weight_max < knapsack_[i]) {
+        weight_max = knapsack_[i];
+      }
+    }
+    std::vector<size_type> unbound;
+    for (size_type item(0); item != size; ++item) {
+      if (!super::IsBound(item)) {
+        unbound.push_back(item);
+      }
+    }
+
+    // Merge identical bound items and drop useless items
+    typedef std::map<std::pair<weight_type, value_type>, size_type> MergeMap;
+    MergeMap merge;
+    std::vector<std::vector<size_type> > group;
+    bool changed(false), all_weight(true);
+    for (size_type item(0); item != size; ++item) {
+      weight_type weight(weight_[item]);
+      value_type value(get_value(item));
+      if (preprocess_) {
+        bool useless(weight > weight_max);
+        for (size_type i(0); !useless && (i != unbound.size()); ++i) {
+          size_type other(unbound[i]);
+          useless = ((other != item) && (weight_[other] <= weight) &&
+            (get_value(other) >= value) && (super::IsBound(item) ||
+              (weight_[other] < weight) || (get_value(other) > value) ||
+              (other < item)));
+        }
+        if (useless) {
+          changed = true;
+          continue;
+        }
+      }
+      all_weight = (all_weight && ValueIsWeight(item));
+      if (preprocess_ && super::IsBound(item)) {
+        std::pair<typename MergeMap::iterator, bool> inserted(merge.insert(
+          std::make_pair(std::make_pair(weight, value), group.size())));
+        if (!inserted.second) {
+          group[inserted.first->second].push_back(item);
+          changed = true;
+          continue;
+        }
+      }
+      group.push_back(std::vector<size_type>(1, item));
+    }
+
+    // Divide by the greatest common divisor
+    weight_type divisor(0);
+    if (preprocess_) {
+      for (size_type i(0); i != super::sack_size(); ++i) {
+        divisor = KnapsackGcd<weight_type>::Gcd(divisor, knapsack_[i]);
+      }
+      for (size_type i(0); i != group.size(); ++i) {
+        divisor = KnapsackGcd<weight_type>::Gcd(divisor,
+          weight_[group[i][0]]);
+      }
+    }
+    if (divisor > 1) {
+      changed = true;
+    } else {
+      divisor = 1;
+    }
+
+    // Split bound items into bundles (of 1, 2, 4, ... copies) if there is
+    // only one knapsack: Every count up to the original count is a sum of
+    // different bundles. More copies than fit into the knapsack are ignored.
+    for (size_type i(0); i != group.size(); ++i) {
+      const std::vector<size_type>& items = group[i];
+      size_type item(items[0]);
+      weight_type weight(weight_[item]);
+      count_type count(0);
+      if (super::IsBound(item)) {
+        for (size_type j(0); j != items.size(); ++j) {
+          count += super::get_count(items[j]);
+        }
+      }
+      if (bundle_ && (super::sack_size() == 1) && (count != 0)) {
+        count_type fit(static_cast<count_type>(knapsack_[0] / weight));
+        if (count > fit) {
+          count = fit;
+        }
+        if (count > kBundleMin) {
+          changed = true;
+          for (count_type multiple(1); count != 0; multiple *= 2) {
+            if (multiple > count) {
+              multiple = count;
+            }
+            origin->push_back(Origin(items, multiple));
+            reduced->weight_.push_back(
+              static_cast<weight_type>(multiple * weight) / divisor);
+            reduced->count_.push_back(1);
+            if (!all_weight) {
+              reduced->value_.push_back(
+                static_cast<value_type>(multiple) * get_value(item));
+            }
+            count -= multiple;
+          }
+          continue;
+        }
+      }
+      origin->push_back(Origin(items, 1));
+      reduced->weight_.push_back(weight / divisor);
+      reduced->count_.push_back(count);
+      if (!all_weight) {
+        reduced->value_.push_back(get_value(item));
+      }
+    }
+    if (!changed) {
+      return false;
+    }
+    for (size_type i(0); i != super::sack_size(); ++i) {
+      reduced->knapsack_.push_back(knapsack_[i] / divisor);
+    }
+    *scale = (all_weight ? static_cast<value_type>(divisor) : value_type(1));
+    return true;
+  }
+
+  // Bound items with a larger count are split into bundles
+  static const unsigned int kBundleMin = 2;
+
+  // Place item into the knapsack at position pos of calc->sack_set_
+  void PlaceAt(Calc *calc, size_type item, size_type pos,
+      SackList *sack_list) const {
+    size_type sack(calc->SackAt(pos));
+    ++(*sack_list)[sack][item];
+    calc->DecreaseBy(sack, weight_[item]);
+  }
+
+  // Follow the decisions of Solve(): First all unbound items are placed,
+  // then the bound items in their order. Each state is followed by the
+  // state of the hash entry to which its entry refers, starting with the
+  // entry next of the initial state.
+  // The entry of a state might have been calculated from another state
+  // with the same hash entry, e.g. with a different assignment of the
+  // knapsacks to the positions. Therefore, of all best placements, the one
+  // into the knapsack with the largest index is selected; this is the one
+  // which Redecide() would select, since the knapsacks are tried from the
+  // last index on, and only a strictly better placement is selected.
+  // If this placement is not equivalent to the one of the entry, the entry
+  // does not refer to its successor, and the remaining decisions are made
+  // by Redecide().
+  // This is only possible if all entries of the path are still in
+  // calc->memo_ (i.e. if no entries were evicted or shared), if the best
+  // positions are stored, and if no placements were pruned: The latter
+  // depends on the state from which the entry was calculated.
+  void Follow(Calc *calc, const void *next, SackList *sack_list) const {
+    const EntryUnbound *unbound(static_cast<const EntryUnbound *>(next));
+    for (; unbound->IsSelected(); unbound =
+      static_cast<const EntryUnbound *>(unbound->get_next())) {
+      size_type pos(calc->Largest(unbound->get_positions()));
+      if (((calc->Equivalent(pos, calc->unbound_high_) >>
+        unbound->get_sack()) & 1) == 0) {
+        Redecide(calc, true, sack_list);
+        return;
+      }
+      PlaceAt(calc, unbound->get_item(), pos, sack_list);
+    }
+    BoundItem& bound = calc->bound_;
+    for (const EntryBound *entry(static_cast<const EntryBound *>(
+      unbound->get_next())); entry != KNAPSACK_NULLPTR;
+      entry = static_cast<const EntryBound *>(entry->get_next())) {
+      if (entry->IsSelected()) {
+        size_type pos(calc->Largest(entry->get_positions()));
+        if ((entry->get_next() != KNAPSACK_NULLPTR) &&
+          (((calc->Equivalent(pos, HighBound(*calc, bound)) >>
+          entry->get_sack()) & 1) == 0)) {
+          Redecide(calc, false, sack_list);
+          return;
+        }
+        PlaceAt(calc, bound.first, pos, sack_list);
+        if (bound.second != 1) {
+          --bound.second;
+          continue;
+        }
+      }
+      // Pass to next item
+      size_type item(FirstBound(bound.first + 1));
+      if (item != super::size()) {
+        bound = BoundItem(item, super::get_count(item));
+      }
+    }
+  }
+
+  // Follow the decisions of Solve() (see Follow()), starting with the
+  // unbound items if unbound is true. The decision for each state is made
+  // anew from the values of its successors: Then the result does not
+  // depend on the order in which the states were calculated (or by which
+  // thread) or on evicted entries.
+  void Redecide(Calc *calc, bool unbound, SackList *sack_list) const {
+    while (unbound) {
+      EntryUnbound entry;
+      DecideUnbound(calc, &entry);
+      if ((unbound = entry.IsSelected())) {
+        PlaceAt(calc, entry.get_item(), entry.get_sack(), sack_list);
+      }
+    }
+    for (bool have_bound(calc->have_bound_); have_bound; ) {
+      const BoundItem& bound = calc->bound_;
+      EntryBound entry;
+      DecideBound(calc, &entry);
+      size_type item(bound.first);
+      if (entry.IsSelected()) {
+        PlaceAt(calc, item, entry.get_sack(), sack_list);
+        if (bound.second != 1) {
+          calc->bound_.second = bound.second - 1;
+          continue;
+        }
+      }
+      // Pass to next item
+      item = FirstBound(item + 1);
+      if ((have_bound = (item != super::size()))) {
+        calc->bound_ = BoundItem(item, super::get_count(item));
+      }
+    }
+  }
+
+  // Solve() with the approximation scheme (see set_epsilon()): The
+  // knapsacks are filled successively by decreasing capacity (ties by
+  // index) with ApproximateSack() from the remaining copies. This keeps at
+  // least (1 - epsilon_) / (2 - epsilon_) times the maximum: If A_j are the
+  // copies in knapsack j of an optimal solution and G those placed here
+  // (of total value g), the copies of A_j not placed before knapsack j
+  // still fit into it, so it gets at least (1 - epsilon_) times
+  // value(A_j) - value(A_j and G). Summing over the disjoint A_j gives
+  // g >= (1 - epsilon_) * (maximum - g). (A scheme with arbitrary precision
+  // exists but is exponential in 1 / epsilon; unless P = NP, none is
+  // polynomial in 1 / epsilon, too.) Finally, if the greedy solution of
+  // Greedy() has a higher value, it is used instead, and its upper bound
+  // decides IsOptimal().
+  value_type SolveApproximate(SackList *sack_list,
+      const KnapsackDeadline *deadline) const {
+    KnapsackStats::Timer timer(&stats_.search_seconds_);
+    size_type size(super::size()), sacks(super::sack_size());
+    std::vector<size_type> order(sacks);
+    for (size_type sack(0); sack != sacks; ++sack) {
+      order[sack] = sack;
+    }
+    std::sort(order.begin(), order.end(), Capacity(*this));
+    std::vector<count_type> left(size);
+    for (size_type item(0); item != size; ++item) {
+      left[item] = super::get_count(item);
+    }
+    SackList approximate(sacks, SackContent());
+    value_type result(0);
+    for (size_type i(0); i != sacks; ++i) {
+      result += ApproximateSack(order[i], &left, &approximate, deadline);
+    }
+    SackList greedy;
+    value_type incumbent(Greedy(sack_list ? &greedy : KNAPSACK_NULLPTR,
+      &upper_bound_));
+    if (result < incumbent) {
+      result = incumbent;
+      approximate.swap(greedy);
+    }
+    if (sack_list) {
+      sack_list->swap(approximate);
+    }
+    optimal_ = !(result < upper_bound_);
+    return result;
+  }
+
+  // Sorts knapsacks by decreasing capacity, ties by index
+  class Capacity {
+   public:
+    explicit Capacity(const Knapsack& knapsack)
+      : knapsack_(knapsack) {
+    }
+
+    bool operator()(size_type a, size_type b) const {
+      return ((knapsack_.knapsack_[a] > knapsack_.knapsack_[b]) ||
+        ((knapsack_.knapsack_[a] == knapsack_.knapsack_[b]) && (a < b)));
+    }
+
+   private:
+    const Knapsack& knapsack_;
+  };
+
+  // Fill the knapsack sack with the remaining copies *left of the items
+  // (0 means unbound) so that its value is at least (1 - epsilon_) times
+  // the maximum: The copies of each item are split into bundles of
+  // 1, 2, 4, ... copies, and the values of the bundles are divided by
+  // epsilon_ * top / n (n bundles, top the most valuable bundle) and
+  // rounded down. The rounding loses less than epsilon_ * top in total,
+  // and top is at most the maximum. For these profits, KnapsackApproximate
+  // finds the best bundles exactly.
+  // The total profit is limited by the scaled bound of the linear
+  // relaxation. Returns the value of the placed items.
+  value_type ApproximateSack(size_type sack, std::vector<count_type> *left,
+      SackList *sack_list, const KnapsackDeadline *deadline) const {
+    weight_type capacity(knapsack_[sack]);
+    std::vector<size_type> bundle_item, density;
+    std::vector<count_type> bundle_count, usable(super::size());
+    long double top(0);
+    for (size_type item(0); item != super::size(); ++item) {
+      weight_type weight(weight_[item]);
+      if (weight > capacity) {
+        continue;
+      }
+      count_type count(static_cast<count_type>(capacity / weight));
+      if (super::IsBound(item) && ((*left)[item] < count)) {
+        count = (*left)[item];
+      }
+      if ((usable[item] = count) != 0) {
+        density.push_back(item);
+      }
+      for (count_type multiple(1); count != 0; multiple *= 2) {
+        if (multiple > count) {
+          multiple = count;
+        }
+        bundle_item.push_back(item);
+        bundle_count.push_back(multiple);
+        long double value(static_cast<long double>(multiple) *
+          static_cast<long double>(get_value(item)));
+        if (top < value) {
+          top = value;
+        }
+        count -= multiple;
+      }
+    }
+    size_type bundles(bundle_item.size());
+    if (bundles == 0) {
+      return 0;
+    }
+    long double factor(static_cast<long double>(epsilon_) * top /
+      static_cast<long double>(bundles));
+    if (!(factor > 0) || (std::numeric_limits<value_type>::is_integer &&
+      (factor < 1))) {
+      factor = 1;
+    }
+
+    // The profits of the bundles and the bound of the linear relaxation
+    std::vector<size_type> profit(bundles);
+    long double total(0);
+    for (size_type i(0); i != bundles; ++i) {
+      profit[i] = static_cast<size_type>(static_cast<long double>(
+        bundle_count[i]) * static_cast<long double>(get_value(
+        bundle_item[i])) / factor);
+      total += static_cast<long double>(profit[i]);
+    }
+    std::sort(density.begin(), density.end(), Density(*this));
+    long double room(static_cast<long double>(capacity)), relaxed(0);
+    for (size_type i(0); (i != density.size()) && (room > 0); ++i) {
+      size_type item(density[i]);
+      long double weight(static_cast<long double>(weight_[item]));
+      long double count(static_cast<long double>(usable[item]));
+      if (count * weight > room) {
+        count = room / weight;
+      }
+      relaxed += count * static_cast<long double>(get_value(item));
+      room -= count * weight;
+    }
+    // 1 more against rounding errors
+    if (total > relaxed / factor + 1) {
+      total = relaxed / factor + 1;
+    }
+
+    Allocator allocator(&arena_);
+    KnapsackApproximate<weight_type, Allocator> approximate(capacity,
+      static_cast<size_type>(total), allocator);
+    for (size_type i(0); i != bundles; ++i) {
+      if (deadline != KNAPSACK_NULLPTR) {
+        deadline->Check();
+      }
+      approximate.Add(static_cast<weight_type>(bundle_count[i] *
+        weight_[bundle_item[i]]), profit[i]);
+    }
+    value_type result(0);
+    size_type p(approximate.Best());
+    for (size_type i(bundles); i != 0; ) {
+      --i;
+      if (!approximate.Taken(i, p)) {
+        continue;
+      }
+      p -= approximate.get_profit(i);
+      size_type item(bundle_item[i]);
+      count_type count(bundle_count[i]);
+      (*sack_list)[sack][item] += count;
+      if (super::IsBound(item)) {
+        (*left)[item] -= count;
+      }
+      result += static_cast<value_type>(count) * get_value(item);
+    }
+    return result;
+  }
+
+  // The solution used if Solve() is stopped early: The items are taken by
+  // decreasing value per weight, and as many copies as possible are placed
+  // into the knapsacks in the order of their indices (first fit). If a
+  // single item is more valuable, only this item is placed instead.
+  // *bound is set to the maximum of the result and the bound of the linear
+  // relaxation (see UpperBound()).
+  value_type Greedy(SackList *sack_list, value_type *bound) const {
+    size_type size(super::size()), sacks(super::sack_size());
+    std::vector<size_type> density(size);
+    for (size_type item(0); item != size; ++item) {
+      density[item] = item;
+    }
+    std::sort(density.begin(), density.end(), Density(*this));
+    typename super::WeightList residual(knapsack_);
+    weight_type weight_max(0);
+    size_type sack_max(0);
+    long double capacity(0);
+    for (size_type sack(0); sack != sacks; ++sack) {
+      capacity += static_cast<long double>(knapsack_[sack]);
+      if (weight_max < knapsack_[sack]) {
+        weight_max = knapsack_[sack];
+        sack_max = sack;
+      }
+    }
+    if (sack_list) {
+      *sack_list = SackList(sacks, SackContent());
+    }
+    value_type result(0);
+    for (size_type i(0); i != size; ++i) {
+      size_type item(density[i]);
+      weight_type weight(weight_[item]);
+      bool unbound(!super::IsBound(item));
+      count_type left(super::get_count(item));
+      for (size_type sack(0); (sack != sacks) && (unbound || (left != 0));
+        ++sack) {
+        count_type fit(static_cast<count_type>(residual[sack] / weight));
+        if (!unbound && (left < fit)) {
+          fit = left;
+        }
+        if (fit == 0) {
+          continue;
+        }
+        residual[sack] -= static_cast<weight_type>(fit * weight);
+        if (!unbound) {
+          left -= fit;
+        }
+        result += static_cast<value_type>(fit) * get_value(item);
+        if (sack_list) {
+          (*sack_list)[sack][item] += fit;
+        }
+      }
+    }
+    size_type best(size);
+    for (size_type item(0); item != size; ++item) {
+      if ((weight_[item] <= weight_max) && ((best == size) ||
+        (get_value(item) > get_value(best)))) {
+        best = item;
+      }
+    }
+    if ((best != size) && (get_value(best) > result)) {
+      result = get_value(best);
+      if (sack_list) {
+        *sack_list = SackList(sacks, SackContent());
+        ++(*sack_list)[sack_max][best];
+      }
+    }
+    long double relaxed(Relaxation(&density[0], size, weight_max, true, true,
+      BoundItem(0, super::get_count(0)), capacity));
+    *bound = ((relaxed < static_cast<long double>(result)) ? result :
+      static_cast<value_type>(relaxed));
+    return result;
+  }
+
+  // Solve() for the instance obtained by Preprocess(), using our arena
+  value_type SolveReduced(Knapsack *reduced, const OriginList& origin,
+      value_type scale, SackList *sack_list) const {
+    reduced->set_max_memory(max_memory_);
+    reduced->set_prune(prune_);
+    reduced->set_threads(threads_);
+    reduced->set_engine(engine_);
+    reduced->set_preprocess(false);
+    reduced->set_bundle(false);
+    reduced->set_time_limit(time_limit_);
+    reduced->set_cancel(cancel_, cancel_data_);
+    reduced->set_epsilon(epsilon_);
+    reduced->set_memo_dir(memo_dir_);
+    reduced->keep_arena_ = keep_arena_;
+    SackList reduced_list;
+    value_type result;
+    {
+      ArenaSwap arena_swap(&arena_, &reduced->arena_);
+      result = reduced->SolveReporting(
+        sack_list ? &reduced_list : KNAPSACK_NULLPTR, reporter_);
+    }
+    evicted_ = reduced->evicted();
+    memory_exceeded_ = reduced->memory_exceeded();
+    engine_used_ = reduced->engine_used();
+    stats_.Add(reduced->get_stats());
+    optimal_ = reduced->IsOptimal();
+    memo_failed_ = reduced->memo_failed();
+    upper_bound_ = reduced->get_upper_bound() * scale;
+    if (sack_list) {
+      // Distribute the merged items to the original items in their order
+      std::vector<count_type> left(super::size());
+      for (size_type item(0); item != super::size(); ++item) {
+        left[item] = super::get_count(item);
+      }
+      for (size_type sack(0); sack != reduced_list.size(); ++sack) {
+        const SackContent& content = reduced_list[sack];
+        for (typename SackContent::const_iterator it(content.begin());
+          it != content.end(); ++it) {
+          const Origin& original = origin[it->first];
+          count_type count(it->second * original.multiple_);
+          for (size_type i(0); count != 0; ++i) {
+            size_type item(original.items_[i]);
+            count_type used(count);
+            if (super::IsBound(item)) {
+              if (left[item] < used) {
+                used = left[item];
+              }
+              left[item] -= used;
+            }
+            if (used != 0) {
+              (*sack_list)[sack][item] += used;
+              count -= used;
+            }
+          }
+        }
+      }
+    }
+    return result * scale;
+  }
+
+ public:
+
+  // If the time limit (see set_time_limit()) or set_cancel() is used,
+  // the greedy solution of Greedy() is calculated first and returned if
+  // the calculation is stopped.
+  value_type Solve(SackList *sack_list = KNAPSACK_NULLPTR) const {
+    if (progress_ == KNAPSACK_NULLPTR) {
+      return SolveReporting(sack_list, KNAPSACK_NULLPTR);
+    }
+    KnapsackReporter reporter(progress_, progress_request_, progress_data_);
+    if (!super::empty() && !super::sack_empty()) {
+      value_type bound;
+      value_type incumbent(Greedy(KNAPSACK_NULLPTR, &bound));
+      reporter.set_incumbent(static_cast<long double>(incumbent),
+        static_cast<long double>(bound));
+    }
+    return SolveReporting(sack_list, &reporter);
+  }
+
+ private:
+  // Solve() with the progress reporting of reporter (0 means none); the
+  // simplified instance of Preprocess() uses the same reporter
+  value_type SolveReporting(SackList *sack_list,
+      const KnapsackReporter *reporter) const {
+    reporter_ = reporter;
+    evicted_ = 0;
+    memory_exceeded_ = false;
+    engine_used_ = super::kEngineAuto;
+    optimal_ = true;
+    memo_failed_ = false;
+    stats_.clear();
+    upper_bound_ = 0;
+    if (sack_list) {
+      *sack_list = SackList(super::sack_size(), SackContent());
+    }
+    if (super::empty() || super::sack_empty()) {
+      return 0;
+    }
+    if (preprocess_ || bundle_) {
+      Knapsack reduced;
+      OriginList origin;
+      value_type scale;
+      bool reduce;
+      {
+        KnapsackStats::Timer timer(&stats_.preprocess_seconds_);
+        reduce = Preprocess(&reduced, &origin, &scale);
+      }
+      if (reduce) {
+        return SolveReduced(&reduced, origin, scale, sack_list);
+      }
+    }
+    ArenaGuard arena_guard(&arena_, keep_arena_);
+    if (!super::Limited()) {
+      return SolveEngine(sack_list, KNAPSACK_NULLPTR);
+    }
+    KnapsackDeadline deadline(time_limit_, cancel_, cancel_data_);
+    SackList greedy;
+    value_type incumbent(Greedy(sack_list ? &greedy : KNAPSACK_NULLPTR,
+      &upper_bound_));
+    try {
+      return SolveEngine(sack_list, &deadline);
+    } catch(const KnapsackInterrupted&) {
+    }
+    if (sack_list) {
+      sack_list->swap(greedy);
+    }
+    optimal_ = !(incumbent < upper_bound_);
+    return incumbent;
+  }
+
+  // Solve() with the approximation scheme or the engine of SelectEngine();
+  // this also sets upper_bound_. If deadline is nonzero, KnapsackInterrupted
+  // is thrown when its limit is reached.
+  value_type SolveEngine(SackList *sack_list,
+      const KnapsackDeadline *deadline) const {
+    if (epsilon_ > 0) {
+      return SolveApproximate(sack_list, deadline);
+    }
+    value_type result;
+    engine_used_ = SelectEngine();
+    switch (engine_used_) {
+      case super::kEngineDense:
+        result = SolveDense(sack_list, deadline);
+        break;
+      case super::kEngineBitset:
+        result = SolveSubsetSum(sack_list, deadline);
+        break;
+      case super::kEngineAuto:
+      case super::kEngineHash:
+      default:
+        result = SolveHash(sack_list, deadline);
+        break;
+    }
+    upper_bound_ = result;
+    return result;
+  }
+
+  // The fingerprint of the items and the number of knapsacks for MemoFile:
+  // The keys of the states and their values depend only on these
+  boost::uint64_t Fingerprint() const {
+    std::size_t seed(0);
+    boost::hash_combine(seed, sizeof(std::size_t));
+    boost::hash_combine(seed, sizeof(weight_type));
+    boost::hash_combine(seed, sizeof(value_type));
+    boost::hash_combine(seed, sizeof(count_type));
+    boost::hash_combine(seed, std::numeric_limits<weight_type>::is_integer);
+    boost::hash_combine(seed, std::numeric_limits<value_type>::is_integer);
+    boost::hash_combine(seed, super::sack_size());
+    boost::hash_combine(seed, super::size());
+    for (size_type item(0); item != super::size(); ++item) {
+      boost::hash_combine(seed, weight_[item]);
+      boost::hash_combine(seed, get_value(item));
+      boost::hash_combine(seed, super::get_count(item));
+    }
+    return seed;
+  }
+
+  // Solve() with the hash engine, using the file of set_memo_dir()
+  value_type SolveHash(SackList *sack_list,
+      const KnapsackDeadline *deadline) const {
+    if (memo_dir_.empty()) {
+      return SolveHash(sack_list, deadline, KNAPSACK_NULLPTR);
+    }
+    boost::uint64_t fingerprint(Fingerprint());
+    MemoFile file(MemoFile::Path(memo_dir_, fingerprint), fingerprint,
+      Allocator(&arena_));
+    value_type result(SolveHash(sack_list, deadline, &file));
+    memo_failed_ = !file.Save();
+    return result;
+  }
+
+  // Solve() with the hash engine; if file is nonzero, the states of file
+  // are used, and the calculated ones are added to it
+  value_type SolveHash(SackList *sack_list, const KnapsackDeadline *deadline,
+      MemoFile *file) const {
+    if (session_ != KNAPSACK_NULLPTR) {
+      session_->Reset(knapsack_);
+      session_->decisions_ = (sack_list != KNAPSACK_NULLPTR);
+      return SolveCalc(session_, sack_list, deadline, file);
+    }
+    Calc calc(knapsack_, max_memory_, sack_list != KNAPSACK_NULLPTR,
+      Allocator(&arena_));
+    return SolveCalc(&calc, sack_list, deadline, file);
+  }
+
+  // SolveHash() with the hashes of calc
+  value_type SolveCalc(Calc *calc, SackList *sack_list,
+      const KnapsackDeadline *deadline, MemoFile *file) const {
+    calc->deadline_ = deadline;
+    calc->reporter_ = reporter_;
+    calc->file_ = file;
+    calc->stats_ = &stats_;
+#ifdef KNAPSACK_THREADS
+    std::unique_ptr<Shared> shared;
+#endif
+    value_type result;
+    {
+      KnapsackStats::Timer timer(&stats_.search_seconds_);
+      calc->density_.clear();
+      if (prune_) {
+        calc->density_.resize(super::size());
+        for (size_type item(0); item != super::size(); ++item) {
+          calc->density_[item] = item;
+        }
+        std::sort(calc->density_.begin(), calc->density_.end(),
+          Density(*this));
+      }
+      SetLimits(calc);
+      size_type item(FirstBound(0));
+      if (item != super::size()) {
+        calc->SetBound(item, super::get_count(item));
+      }
+#ifdef KNAPSACK_THREADS
+      if (threads_ > 1) {
+        shared.reset(new Shared(super::sack_size(), max_memory_,
+          calc->decisions_));
+        calc->shared_ = shared.get();
+        Prefetch(*calc, calc->shared_);
+      }
+#endif
+      result = SolveUnbound(calc);
+    }
+    upper_bound_ = result;  // even if the reconstruction is stopped
+    if (sack_list) {
+      KnapsackStats::Timer timer(&stats_.decide_seconds_);
+      if ((calc->found_ != KNAPSACK_NULLPTR) && calc->Follows() && !prune_ &&
+        (super::sack_size() <= kMaxPositions)) {
+        Follow(calc, calc->found_, sack_list);
+      } else {
+        Redecide(calc, true, sack_list);
+      }
+    }
+    evicted_ = calc->evicted();
+    memory_exceeded_ = calc->exceeded();
+#ifdef KNAPSACK_STATS
+    calc->memo_.CountBytes(&stats_);
+    calc->values_.CountBytes(&stats_);
+#endif
+#ifdef KNAPSACK_THREADS
+    if (shared) {
+      evicted_ += shared->evicted();
+      memory_exceeded_ = (memory_exceeded_ || shared->exceeded());
+#ifdef KNAPSACK_STATS
+      shared->CountBytes(&stats_);
+#endif
+    }
+#endif
+    if (file != KNAPSACK_NULLPTR) {
+      calc->memo_.SaveTo(file);
+      calc->values_.SaveTo(file);
+#ifdef KNAPSACK_THREADS
+      if (shared) {
+        shared->SaveTo(file);
+      }
+#endif
     }
     return result;
   }
 
+  // If nonzero, SolveHash() uses this calculation of a Session
+  Calc *session_;
+
+  // The progress reporting of the current Solve() (see set_progress())
+  mutable const KnapsackReporter *reporter_;
+
+ public:
+  // A calculation whose hashes are kept from one Solve() to the next while
+  // the items and knapsacks of knapsack change in between: Only the entries
+  // which depend on changed items are removed (see knapsack.txt).
+  // The items are calculated in reverse order so that the entries of an
+  // item depend only on this and the previous items; appending items or
+  // changing capacities keeps all entries of bound items.
+  // Unless set_epsilon() is used, Solve() uses kEngineHash with one thread
+  // and without the simplifications of set_preprocess() or set_memo_dir();
+  // the other settings of knapsack are used, and its evicted(),
+  // IsOptimal(), and get_upper_bound() refer to the last Session::Solve().
+  // The value is the same as with knapsack.Solve(), but if there are
+  // several optimal solutions, another one might be returned.
+  class Session {
+   public:
+    explicit Session(const Knapsack& knapsack)
+      : knapsack_(knapsack), calc_(KNAPSACK_NULLPTR), invalidated_(0) {
+    }
+
+    ~Session() {
+      delete calc_;
+    }
+
+    // Knapsack::Solve() for the current items and knapsacks of knapsack.
+    // The approximation scheme (see set_epsilon()) uses no hashes; then
+    // this is just Knapsack::Solve().
+    value_type Solve(SackList *sack_list = KNAPSACK_NULLPTR) {
+      if (knapsack_.epsilon_ > 0) {
+        invalidated_ = 0;
+        return knapsack_.Solve(sack_list);
+      }
+      Update();
+      SackList reversed;
+      value_type result(reversed_.Solve(
+        sack_list ? &reversed : KNAPSACK_NULLPTR));
+      knapsack_.evicted_ = reversed_.evicted();
+      knapsack_.memory_exceeded_ = reversed_.memory_exceeded();
+      knapsack_.engine_used_ = reversed_.engine_used();
+      knapsack_.optimal_ = reversed_.IsOptimal();
+      knapsack_.stats_ = reversed_.get_stats();
+      knapsack_.upper_bound_ = reversed_.get_upper_bound();
+      if (sack_list) {
+        size_type size(reversed_.size());
+        *sack_list = SackList(reversed.size(), SackContent());
+        for (size_type sack(0); sack != reversed.size(); ++sack) {
+          const SackContent& content = reversed[sack];
+          for (typename SackContent::const_iterator it(content.begin());
+            it != content.end(); ++it) {
+            (*sack_list)[sack][size - 1 - it->first] = it->second;
+          }
+        }
+      }
+      return result;
+    }
+
+    // The number of entries removed by the last Solve() because items
+    // had changed
+    std::size_t invalidated() const {
+      return invalidated_;
+    }
+
+    // Knapsack::SolveAppend() and SolveValueAppend() with Solve()
+    void SolveAppend(std::string *str) {
+      SackList sack_list;
+      value_type result(Solve(&sack_list));
+      knapsack_.SolutionAppend(result, sack_list, str);
+    }
+
+    void SolveValueAppend(std::string *str) {
+      str->append((knapsack_.FormatValue() % Solve()).str());
+    }
+
+   private:
+    const Knapsack& knapsack_;
+
+    // The items of knapsack_ in reverse order as of the last Solve()
+    Knapsack reversed_;
+
+    // The calculation of reversed_ (allocated from arena_)
+    KnapsackArena arena_;
+    Calc *calc_;
+
+    std::size_t invalidated_;
+
+    // Whether item of knapsack_ is unchanged in reversed_
+    bool Same(size_type item) const {
+      size_type old(reversed_.size() - 1 - item);
+      value_type value(knapsack_.get_value(item)),
+        old_value(reversed_.get_value(old));
+      return ((knapsack_.weight_[item] == reversed_.weight_[old]) &&
+        !(value < old_value) && !(old_value < value) &&
+        (knapsack_.get_count(item) == reversed_.get_count(old)));
+    }
+
+    // Delete calc_ and reuse the memory of arena_
+    void Drop() {
+      delete calc_;
+      calc_ = KNAPSACK_NULLPTR;
+      arena_.Reset();
+    }
+
+    // Remove the entries of changed items and copy knapsack_ to reversed_
+    void Update() {
+      const Knapsack& knapsack = knapsack_;
+      size_type size(knapsack.size()), old(reversed_.size()), first(0);
+      while ((first != size) && (first != old) && Same(first)) {
+        ++first;
+      }
+      invalidated_ = 0;
+      if ((calc_ != KNAPSACK_NULLPTR) &&
+        (calc_->sack_set_.size() != knapsack.sack_size())) {
+        Drop();
+      }
+      if ((calc_ != KNAPSACK_NULLPTR) && ((first != old) || (size != old))) {
+        invalidated_ = calc_->Invalidate(first);
+        // The hashes keep their memory in arena_ (and what they had
+        // before growing); if most entries are gone, start anew
+        std::size_t entries(calc_->entries());
+        if (invalidated_ > entries) {
+          invalidated_ += entries;
+          Drop();
+        }
+      }
+      if ((calc_ == KNAPSACK_NULLPTR) && !knapsack.sack_empty()) {
+        calc_ = new Calc(knapsack.knapsack_, knapsack.max_memory_, true,
+          Allocator(&arena_));
+      }
+      reversed_.weight_.resize(size);
+      reversed_.value_.resize(size);
+      reversed_.count_.resize(size);
+      for (size_type item(0); item != size; ++item) {
+        size_type to(size - 1 - item);
+        reversed_.weight_[to] = knapsack.weight_[item];
+        reversed_.value_[to] = knapsack.get_value(item);
+        reversed_.count_[to] = knapsack.get_count(item);
+      }
+      reversed_.knapsack_ = knapsack.knapsack_;
+      reversed_.set_max_memory(knapsack.max_memory_);
+      reversed_.set_prune(knapsack.prune_);
+      reversed_.set_threads(1);
+      reversed_.set_engine(KnapsackBase::kEngineHash);
+      reversed_.set_preprocess(false);
+      reversed_.set_bundle(false);
+      reversed_.set_time_limit(knapsack.time_limit_);
+      reversed_.set_cancel(knapsack.cancel_, knapsack.cancel_data_);
+      reversed_.set_progress(knapsack.progress_, knapsack.progress_request_,
+        knapsack.progress_data_);
+      reversed_.set_keep_arena(true);
+      reversed_.session_ = calc_;
+      if (calc_ != KNAPSACK_NULLPTR) {
+        calc_->reverse_ = size;
+      }
+    }
+
+    // This class is not meant to be copied
+    Session(const Session&);
+    Session& operator=(const Session&);
+  };
+
   virtual boost::format FormatResult() const {
     return boost::format("%s\n%s");
   }
 
+  virtual boost::format FormatValue() const {
+    return boost::format("%s\n");
+  }
+
   virtual boost::format FormatKnapsackWeight() const {
     return boost::format("%s|%s: %s\n");
   }
@@ -522,6 +3301,10 @@ template <class Weight, class Value,
     return boost::format("%1%%2%*%3%=%4%(%2%*%5%=%6%)");
   }
 
+  virtual boost::format FormatLabel() const {
+    return boost::format("[%s]");
+  }
+
   virtual const char *FormatInitialSeparator() const {
     return "";
   }
@@ -533,13 +3316,27 @@ template <class Weight, class Value,
   virtual void SolveAppend(std::string *str) const {
     SackList sack_list;
     value_type result(Solve(&sack_list));
+    SolutionAppend(result, sack_list, str);
+  }
+
+  // Append only the maximal value; this is faster and needs less memory
+  // since no decisions are stored
+  virtual void SolveValueAppend(std::string *str) const {
+    str->append((FormatValue() % Solve()).str());
+  }
+
+ private:
+  // The output of SolveAppend() for the given result of Solve()
+  void SolutionAppend(value_type result, const SackList& sack_list,
+      std::string *str) const {
     boost::format
       simple_weight(FormatSimpleWeight()),
       simple_value(FormatSimpleValue()),
       multi_weight(FormatMultiWeight()),
       multi_value(FormatMultiValue()),
       knapsack_weight(FormatKnapsackWeight()),
-      knapsack_value(FormatKnapsackValue());
+      knapsack_value(FormatKnapsackValue()),
+      label(FormatLabel());
     std::string sacks;
     for (size_type i(0); i < sack_list.size(); ++i) {
       const SackContent& sack = sack_list[i];
@@ -584,6 +3381,9 @@ template <class Weight, class Value,
               total_weight % value % total_value).str());
           }
         }
+        if (super::HasLabel(item)) {
+          content.append((label % label_[item]).str());
+        }
         sep = FormatSeparator();
       }
       if (weight_value_equal) {
@@ -596,6 +3396,12 @@ template <class Weight, class Value,
     }
     str->append((FormatResult() % result % sacks).str());
   }
+
+ public:
+  // Append get_upper_bound() (without a newline)
+  virtual void UpperBoundAppend(std::string *str) const {
+    str->append((boost::format("%s") % upper_bound_).str());
+  }
 };
 
 #endif  // KNAPSACK_KNAPSACK_H_
@@ -0,0 +1,377 @@
+// This file is part of the knapsack project and distributed under the
+// terms of the GNU General Public License v2.
+// SPDX-License-Identifier: GPL-2.0-only
+//
+// Copyright (c)
+//   Martin Väth <martin@mvath.de>
+
+#ifndef KNAPSACK_MEMO_FILE_H_
+#define KNAPSACK_MEMO_FILE_H_ 1
+
+#include <boost/cstdint.hpp>  // boost::uint64_t
+
+#include <algorithm>  // std::equal
+#include <cstdio>  // std::FILE, std::fopen, std::rename, std::remove
+#include <cstdlib>  // std::size_t
+#include <cstring>  // std::memcpy
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "knapsack/memo_table.h"
+#include "knapsack/nullptr.h"
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(KNAPSACK_NO_MMAP)
+#define KNAPSACK_MMAP 1
+#endif
+
+#ifdef KNAPSACK_MMAP
+#include <fcntl.h>  // open
+#include <sys/mman.h>  // mmap, munmap
+#include <sys/stat.h>  // fstat
+#include <unistd.h>  // close, getpid
+#endif
+
+// A file which stores the values of the states of the hashes of
+// Knapsack::Solve() from one run to the next. Since the key of a state
+// (see KnapsackKey) refers to the items by their index and the values
+// depend on all items, the file is only valid for the same items and the
+// same number of knapsacks; this is described by a fingerprint which is
+// stored in the file. The capacities of the knapsacks need not be the same:
+// The states of the remaining items are shared.
+//
+// The file consists of a header, an open addressing table with linear
+// probing (the hash of a state and the offset of its record), and the
+// records (the kind of the state, its value, and its key). It is mapped
+// into memory (if KNAPSACK_MMAP is defined) and used as is: Nothing is
+// built when it is opened, and Find() is const and may be called from
+// several threads at once. The data is stored in the native format;
+// a file of another architecture has a different fingerprint or magic.
+//
+// The states calculated in a run are collected with Add() (see Collect)
+// and written by Save() together with those of the opened file: A new file
+// is written and then renamed, so a file which is mapped is never changed.
+
+template <class Value, class Allocator>
+class KnapsackMemoFile {
+ public:
+  typedef Value value_type;
+  typedef std::size_t size_type;
+  typedef KnapsackKey<Allocator> Key;
+
+  enum Kind {
+    kUnbound,
+    kBound
+  };
+
+  // If the file path does not exist or does not match fingerprint, the
+  // table is empty
+  KnapsackMemoFile(const std::string& path, boost::uint64_t fingerprint,
+      const Allocator& allocator)
+    : path_(path), fingerprint_(fingerprint), words_(KNAPSACK_NULLPTR),
+    table_(KNAPSACK_NULLPTR), slots_(0), mask_(0), records_(KNAPSACK_NULLPTR),
+    record_bytes_(0),
+#ifdef KNAPSACK_MMAP
+    map_(KNAPSACK_NULLPTR), map_bytes_(0),
+#endif
+    buffer_(WordAllocator(allocator)), added_(ByteAllocator(allocator)),
+    added_hash_(WordAllocator(allocator)),
+    added_offset_(SizeAllocator(allocator)) {
+    Open();
+  }
+
+  ~KnapsackMemoFile() {
+    Close();
+  }
+
+  // The file of the given fingerprint in the directory dir
+  static std::string Path(const std::string& dir,
+      boost::uint64_t fingerprint) {
+    std::ostringstream path;
+    path << dir << "/knapsack-" << std::hex << fingerprint << ".memo";
+    return path.str();
+  }
+
+  // The number of states of the opened file
+  size_type size() const {
+    return ((words_ == KNAPSACK_NULLPTR) ? 0 :
+      static_cast<size_type>(words_[kSize]));
+  }
+
+  // Copy the value of the state with key (which was calculated with hash)
+  // of the opened file. Returns false if it is not found.
+  bool Find(Kind kind, std::size_t hash, const Key& key,
+      value_type *value) const {
+    if (slots_ == 0) {
+      return false;
+    }
+    for (size_type i(hash & mask_); ; i = ((i + 1) & mask_)) {
+      const boost::uint64_t *slot(table_ + 2 * i);
+      if (slot[1] == 0) {
+        return false;
+      }
+      if (slot[0] == static_cast<boost::uint64_t>(hash)) {
+        const unsigned char *record(records_ + (slot[1] - 1));
+        if ((record[0] == kind) && key.Equal(record + kKeyStart)) {
+          std::memcpy(value, record + 1, sizeof(value_type));
+          return true;
+        }
+      }
+    }
+  }
+
+  // Remember a state for Save(); key is in the format of KnapsackKey
+  void Add(Kind kind, std::size_t hash, const unsigned char *key,
+      value_type value) {
+    added_hash_.push_back(static_cast<boost::uint64_t>(hash));
+    added_offset_.push_back(added_.size());
+    added_.push_back(static_cast<unsigned char>(kind));
+    const unsigned char *data(reinterpret_cast<const unsigned char *>(
+      &value));
+    added_.insert(added_.end(), data, data + sizeof(value_type));
+    added_.insert(added_.end(), key, key + Key::Size(key));
+  }
+
+  // A function object for KnapsackMemo::Visit() which calls Add()
+  class Collect {
+   public:
+    Collect(KnapsackMemoFile *file, Kind kind)
+      : file_(file), kind_(kind) {
+    }
+
+    template <class Entry>
+    void operator()(std::size_t hash, const unsigned char *key,
+        const Entry& entry) {
+      file_->Add(kind_, hash, key, entry.get_value());
+    }
+
+   private:
+    KnapsackMemoFile *file_;
+    Kind kind_;
+  };
+
+  // Write the states of the opened file and of Add() (without duplicates)
+  // to path. Returns false if this fails; then path is unchanged.
+  bool Save() const {
+    if (added_hash_.empty()) {
+      return true;
+    }
+    size_type count(size() + added_hash_.size()), slots(16);
+    while (3 * slots < 4 * count) {
+      slots *= 2;
+    }
+    WordList table(2 * slots, boost::uint64_t(0), buffer_.get_allocator());
+    for (size_type i(0); i != slots_ * 2; i += 2) {
+      if (table_[i + 1] != 0) {
+        Place(&table, table_[i], table_[i + 1]);
+      }
+    }
+    count = size();
+    ByteList records(records_, records_ + record_bytes_,
+      added_.get_allocator());
+    for (size_type i(0); i != added_hash_.size(); ++i) {
+      const unsigned char *record(&added_[added_offset_[i]]);
+      size_type bytes(kKeyStart + Key::Size(record + kKeyStart));
+      if (Contains(table, records, added_hash_[i], record, bytes)) {
+        continue;
+      }
+      Place(&table, added_hash_[i], records.size() + 1);
+      records.insert(records.end(), record, record + bytes);
+      ++count;
+    }
+    boost::uint64_t header[kHeaderWords];
+    header[kMagic] = kMagicNumber;
+    header[kFingerprint] = fingerprint_;
+    header[kSlots] = slots;
+    header[kSize] = count;
+    header[kRecordBytes] = records.size();
+    std::string temp(TempPath());
+    std::FILE *file(std::fopen(temp.c_str(), "wb"));
+    if (file == KNAPSACK_NULLPTR) {
+      return false;
+    }
+    bool success((std::fwrite(header, sizeof(header), 1, file) == 1) &&
+      (std::fwrite(&table[0], sizeof(table[0]), table.size(), file) ==
+        table.size()) && (records.empty() ||
+      (std::fwrite(&records[0], 1, records.size(), file) ==
+        records.size())));
+    if ((std::fclose(file) != 0) || !success ||
+      (std::rename(temp.c_str(), path_.c_str()) != 0)) {
+      std::remove(temp.c_str());
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  typedef typename Allocator::template rebind<boost::uint64_t>::other
+    WordAllocator;
+  typedef typename Allocator::template rebind<unsigned char>::other
+    ByteAllocator;
+  typedef typename Allocator::template rebind<size_type>::other
+    SizeAllocator;
+  typedef std::vector<boost::uint64_t, WordAllocator> WordList;
+  typedef std::vector<unsigned char, ByteAllocator> ByteList;
+  typedef std::vector<size_type, SizeAllocator> SizeList;
+
+  // The words of the header
+  enum {
+    kMagic,
+    kFingerprint,
+    kSlots,  // a power of 2
+    kSize,
+    kRecordBytes,
+    kHeaderWords
+  };
+
+  static const boost::uint64_t kMagicNumber =
+    (boost::uint64_t(0x314F4D45U) << 32) | 0x50414E4BU;  // "KNAPEMO1"
+  static const size_type kKeyStart = 1 + sizeof(value_type);
+
+  std::string path_;
+  boost::uint64_t fingerprint_;
+  const boost::uint64_t *words_;  // the opened file; 0 if there is none
+  const boost::uint64_t *table_;
+  size_type slots_, mask_;
+  const unsigned char *records_;
+  size_type record_bytes_;
+#ifdef KNAPSACK_MMAP
+  void *map_;
+  std::size_t map_bytes_;
+#endif
+  WordList buffer_;  // the file if it is not mapped
+  ByteList added_;  // the records of Add()
+  WordList added_hash_;
+  SizeList added_offset_;
+
+  void Open() {
+#ifdef KNAPSACK_MMAP
+    int fd(open(path_.c_str(), O_RDONLY));
+    if (fd < 0) {
+      return;
+    }
+    struct stat status;
+    if ((fstat(fd, &status) == 0) && (status.st_size > 0)) {
+      map_bytes_ = static_cast<std::size_t>(status.st_size);
+      map_ = mmap(KNAPSACK_NULLPTR, map_bytes_, PROT_READ, MAP_SHARED, fd, 0);
+      if (map_ == MAP_FAILED) {
+        map_ = KNAPSACK_NULLPTR;
+      } else {
+        words_ = static_cast<const boost::uint64_t *>(map_);
+      }
+    }
+    close(fd);
+    if (words_ != KNAPSACK_NULLPTR) {
+      Check(map_bytes_);
+    }
+#else
+    std::FILE *file(std::fopen(path_.c_str(), "rb"));
+    if (file == KNAPSACK_NULLPTR) {
+      return;
+    }
+    std::vector<unsigned char> bytes;
+    unsigned char chunk[4096];
+    for (std::size_t read;
+      (read = std::fread(chunk, 1, sizeof(chunk), file)) != 0; ) {
+      bytes.insert(bytes.end(), chunk, chunk + read);
+    }
+    std::fclose(file);
+    buffer_.resize((bytes.size() + sizeof(boost::uint64_t) - 1) /
+      sizeof(boost::uint64_t));
+    if (!bytes.empty()) {
+      std::memcpy(&buffer_[0], &bytes[0], bytes.size());
+      words_ = &buffer_[0];
+      Check(bytes.size());
+    }
+#endif
+  }
+
+  // Check the header of the opened file of the given size
+  void Check(std::size_t bytes) {
+    std::size_t header(kHeaderWords * sizeof(boost::uint64_t));
+    if ((bytes < header) || (words_[kMagic] != kMagicNumber) ||
+      (words_[kFingerprint] != fingerprint_)) {
+      Close();
+      return;
+    }
+    boost::uint64_t slots(words_[kSlots]);
+    if ((slots == 0) || ((slots & (slots - 1)) != 0) ||
+      (slots > (bytes - header) / (2 * sizeof(boost::uint64_t))) ||
+      (words_[kRecordBytes] != bytes - header -
+        2 * sizeof(boost::uint64_t) * slots)) {
+      Close();
+      return;
+    }
+    slots_ = static_cast<size_type>(slots);
+    mask_ = slots_ - 1;
+    table_ = words_ + kHeaderWords;
+    records_ = reinterpret_cast<const unsigned char *>(table_ + 2 * slots_);
+    record_bytes_ = static_cast<size_type>(words_[kRecordBytes]);
+  }
+
+  void Close() {
+#ifdef KNAPSACK_MMAP
+    if (map_ != KNAPSACK_NULLPTR) {
+      munmap(map_, map_bytes_);
+      map_ = KNAPSACK_NULLPTR;
+    }
+#endif
+    WordList(buffer_.get_allocator()).swap(buffer_);
+    words_ = KNAPSACK_NULLPTR;
+    table_ = KNAPSACK_NULLPTR;
+    slots_ = 0;
+    mask_ = 0;
+    records_ = KNAPSACK_NULLPTR;
+    record_bytes_ = 0;
+  }
+
+  // A name for the new file which is not used by another process or object
+  std::string TempPath() const {
+    std::ostringstream temp;
+    temp << path_ << '.';
+#ifdef KNAPSACK_MMAP
+    temp << getpid() << '.';
+#endif
+    temp << static_cast<const void *>(this) << ".tmp";
+    return temp.str();
+  }
+
+  // Insert the offset (+ 1) of a record into table with 2 * slots words
+  void Place(WordList *table, boost::uint64_t hash,
+      boost::uint64_t offset) const {
+    size_type mask(table->size() / 2 - 1);
+    size_type i(static_cast<size_type>(hash) & mask);
+    while ((*table)[2 * i + 1] != 0) {
+      i = ((i + 1) & mask);
+    }
+    (*table)[2 * i] = hash;
+    (*table)[2 * i + 1] = offset;
+  }
+
+  // Whether table contains the record (of the given size), ignoring values
+  static bool Contains(const WordList& table, const ByteList& records,
+      boost::uint64_t hash, const unsigned char *record, size_type bytes) {
+    size_type mask(table.size() / 2 - 1);
+    for (size_type i(static_cast<size_type>(hash) & mask); ;
+      i = ((i + 1) & mask)) {
+      if (table[2 * i + 1] == 0) {
+        return false;
+      }
+      if (table[2 * i] != hash) {
+        continue;
+      }
+      const unsigned char *other(&records[table[2 * i + 1] - 1]);
+      if ((other[0] == record[0]) && std::equal(record + kKeyStart,
+        record + bytes, other + kKeyStart)) {
+        return true;
+      }
+    }
+  }
+
+  // This class is not meant to be copied
+  KnapsackMemoFile(const KnapsackMemoFile&);
+  KnapsackMemoFile& operator=(const KnapsackMemoFile&);
+};
+
+#endif  // KNAPSACK_MEMO_FILE_H_
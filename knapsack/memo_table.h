@@ -0,0 +1,825 @@
+// This file is part of the knapsack project and distributed under the
+// terms of the GNU General Public License v2.
+// SPDX-License-Identifier: GPL-2.0-only
+//
+// Copyright (c)
+//   Martin Väth <martin@mvath.de>
+
+#ifndef KNAPSACK_MEMO_TABLE_H_
+#define KNAPSACK_MEMO_TABLE_H_ 1
+
+#include <boost/cstdint.hpp>  // boost::uint32_t, boost::uint64_t
+
+#include <algorithm>  // std::copy, std::equal, std::fill
+#include <limits>
+
+#ifdef KNAPSACK_BOOST_UNORDERED
+#include <boost/functional/hash.hpp>  // boost::hash
+#include <boost/unordered_map.hpp>  // boost::unordered_map
+
+#include <functional>  // std::equal_to
+#endif
+
+#include <cstdlib>  // std::size_t
+#include <cstring>  // std::memcpy
+#include <new>  // placement new
+#include <stdexcept>  // std::length_error
+#include <utility>  // std::pair
+
+#include <vector>
+
+#include "knapsack/nullptr.h"
+
+// The memoization tables of Knapsack::Calc.
+// A table maps a state (a Header like the current bound item and the sorted
+// residual capacities of the knapsacks) to an Entry.
+// The hash of the state is calculated by the caller.
+//
+// The default implementation uses open addressing with linear probing:
+// The table itself contains only a part of the hash and an index.
+// The full hashes, entries, and the positions of the keys are appended to
+// separate lists which are allocated in chunks; in particular, entries never
+// move in memory. The key is the header and the residual capacities in a
+// compact format (see KnapsackKey) which is appended to a list of bytes.
+// All memory is obtained from Allocator (see knapsack/arena.h); Header and
+// Entry are never destructed.
+//
+// Each entry stores a cost (the number of states computed to obtain it).
+// Evict(min_cost) removes all entries with a smaller cost, RemoveIf() those
+// with certain headers. The remaining entries are moved within the
+// allocated memory which is then reused; in particular, after Evict() or
+// RemoveIf() entries can move.
+//
+// If KNAPSACK_BOOST_UNORDERED is defined, boost::unordered_map is used
+// instead (with the same interface) which might be useful for comparison.
+
+// An empty Header
+class KnapsackNoHeader {
+ public:
+  bool operator==(const KnapsackNoHeader& /* h */) const {
+    return true;
+  }
+};
+
+// An append-only list of elements, each consisting of stride objects of
+// type T. The data is allocated in chunks so that it never moves.
+// Append() returns uninitialized memory, and the objects are never destructed.
+template <class T, class Allocator>
+class KnapsackChunks {
+ public:
+  typedef std::size_t size_type;
+
+  KnapsackChunks(size_type stride, const Allocator& allocator)
+    : chunk_(PointerAllocator(allocator)), allocator_(allocator),
+    stride_(stride), size_(0) {
+  }
+
+  ~KnapsackChunks() {
+    clear();
+  }
+
+  size_type size() const {
+    return size_;
+  }
+
+  size_type stride() const {
+    return stride_;
+  }
+
+  // The number of bytes allocated
+  std::size_t bytes() const {
+    return chunk_.size() * kChunkSize * stride_ * sizeof(T);
+  }
+
+  T *get(size_type index) {
+    return chunk_[index >> kChunkShift] + (index & kChunkMask) * stride_;
+  }
+
+  const T *get(size_type index) const {
+    return chunk_[index >> kChunkShift] + (index & kChunkMask) * stride_;
+  }
+
+  // Return the (uninitialized) data for a new element
+  T *Append() {
+    if (((size_ & kChunkMask) == 0) && ((size_ >> kChunkShift) ==
+      chunk_.size())) {
+      chunk_.push_back(allocator_.allocate(kChunkSize * stride_));
+    }
+    return get(size_++);
+  }
+
+  // Forget all elements from index size on; the memory is kept for reuse
+  void Truncate(size_type size) {
+    size_ = size;
+  }
+
+  void clear() {
+    for (typename ChunkList::iterator it(chunk_.begin()); it != chunk_.end();
+      ++it) {
+      allocator_.deallocate(*it, kChunkSize * stride_);
+    }
+    chunk_.clear();
+    size_ = 0;
+  }
+
+ private:
+  typedef typename Allocator::template rebind<T>::other TAllocator;
+  typedef typename Allocator::template rebind<T *>::other PointerAllocator;
+  typedef std::vector<T *, PointerAllocator> ChunkList;
+  static const unsigned int kChunkShift = 12;
+  static const size_type kChunkSize = (size_type(1) << kChunkShift);
+  static const size_type kChunkMask = kChunkSize - 1;
+
+  ChunkList chunk_;
+  TAllocator allocator_;
+  size_type stride_, size_;
+
+  // This class is not meant to be copied
+  KnapsackChunks(const KnapsackChunks&);
+  KnapsackChunks& operator=(const KnapsackChunks&);
+};
+
+// Appending a number to a list of bytes (see KnapsackKey): Integers are
+// stored as varints, i.e. 7 bits per byte, starting with the lowest ones;
+// the highest bit of a byte means that more bytes follow. Other types are
+// stored bytewise. Difference() is used for sorted lists and Sum() undoes
+// it; Read() reads a number and advances *bytes.
+template <class T, bool kInteger = std::numeric_limits<T>::is_integer>
+class KnapsackVarint {
+ public:
+  template <class Bytes>
+  static void Append(T value, Bytes *bytes) {
+    boost::uint64_t number(static_cast<boost::uint64_t>(value));
+    for (; number >= 0x80; number >>= 7) {
+      bytes->push_back(static_cast<unsigned char>(number | 0x80));
+    }
+    bytes->push_back(static_cast<unsigned char>(number));
+  }
+
+  static T Read(const unsigned char **bytes) {
+    boost::uint64_t number(0);
+    for (unsigned int shift(0); ; shift += 7) {
+      unsigned char byte(*((*bytes)++));
+      number |= (boost::uint64_t(byte & 0x7F) << shift);
+      if ((byte & 0x80) == 0) {
+        return static_cast<T>(number);
+      }
+    }
+  }
+
+  static T Difference(T value, T previous) {
+    return static_cast<T>(value - previous);
+  }
+
+  static T Sum(T previous, T difference) {
+    return static_cast<T>(previous + difference);
+  }
+};
+
+template <class T>
+class KnapsackVarint<T, false> {
+ public:
+  template <class Bytes>
+  static void Append(T value, Bytes *bytes) {
+    const unsigned char *data(reinterpret_cast<const unsigned char *>(
+      &value));
+    bytes->insert(bytes->end(), data, data + sizeof(T));
+  }
+
+  static T Read(const unsigned char **bytes) {
+    T value;
+    std::memcpy(&value, *bytes, sizeof(T));
+    *bytes += sizeof(T);
+    return value;
+  }
+
+  static T Difference(T value, T /* previous */) {
+    return value;
+  }
+
+  static T Sum(T /* previous */, T difference) {
+    return difference;
+  }
+};
+
+// The encoding of the header of a state (see KnapsackKey)
+template <class Bytes>
+void KnapsackAppendHeader(const KnapsackNoHeader& /* header */,
+    Bytes * /* bytes */) {
+}
+
+template <class First, class Second, class Bytes>
+void KnapsackAppendHeader(const std::pair<First, Second>& header,
+    Bytes *bytes) {
+  KnapsackVarint<First>::Append(header.first, bytes);
+  KnapsackVarint<Second>::Append(header.second, bytes);
+}
+
+// The decoding of KnapsackAppendHeader()
+inline void KnapsackReadHeader(const unsigned char ** /* bytes */,
+    KnapsackNoHeader * /* header */) {
+}
+
+template <class First, class Second>
+void KnapsackReadHeader(const unsigned char **bytes,
+    std::pair<First, Second> *header) {
+  header->first = KnapsackVarint<First>::Read(bytes);
+  header->second = KnapsackVarint<Second>::Read(bytes);
+}
+
+// The key of a state in a compact format: the number of the following
+// bytes, the header, and the sorted residual capacities as differences to
+// their predecessors (all as varints, see KnapsackVarint).
+// Typically, each number needs only one or two bytes.
+template <class Allocator>
+class KnapsackKey {
+ public:
+  typedef std::size_t size_type;
+  typedef std::vector<unsigned char,
+    typename Allocator::template rebind<unsigned char>::other> ByteList;
+
+  explicit KnapsackKey(const Allocator& allocator)
+    : bytes_(allocator), data_(allocator) {
+  }
+
+  // The maximal number of bytes of a key with the given number of sacks
+  static size_type MaxBytes(size_type sacks) {
+    return 11 * (sacks + 3);
+  }
+
+  template <class Header, class State>
+  void assign(const Header& header, const State& state) {
+    typedef typename State::weight_type weight_type;
+    data_.clear();
+    KnapsackAppendHeader(header, &data_);
+    weight_type previous(0);
+    for (typename State::const_iterator it(state.begin());
+      it != state.end(); ++it) {
+      KnapsackVarint<weight_type>::Append(
+        KnapsackVarint<weight_type>::Difference(*it, previous), &data_);
+      previous = *it;
+    }
+    bytes_.clear();
+    KnapsackVarint<size_type>::Append(data_.size(), &bytes_);
+    bytes_.insert(bytes_.end(), data_.begin(), data_.end());
+  }
+
+  size_type size() const {
+    return bytes_.size();
+  }
+
+  const unsigned char *data() const {
+    return &bytes_[0];
+  }
+
+  // Whether the key stored at key equals this one
+  bool Equal(const unsigned char *key) const {
+    size_type length(0);
+    for (unsigned int shift(0); ; shift += 7) {
+      unsigned char byte(*(key++));
+      length |= (size_type(byte & 0x7F) << shift);
+      if ((byte & 0x80) == 0) {
+        break;
+      }
+    }
+    return ((length == data_.size()) &&
+      std::equal(data_.begin(), data_.end(), key));
+  }
+
+  // Whether the key stored at key is the key of the given header and state;
+  // this decodes the stored key instead of encoding the state
+  template <class Header, class State>
+  static bool Matches(const unsigned char *key, const Header& header,
+      const State& state) {
+    typedef typename State::weight_type weight_type;
+    size_type length(KnapsackVarint<size_type>::Read(&key));
+    const unsigned char *end(key + length);
+    Header stored;
+    KnapsackReadHeader(&key, &stored);
+    if (!(stored == header)) {
+      return false;
+    }
+    weight_type previous(0);
+    for (typename State::const_iterator it(state.begin());
+      it != state.end(); ++it) {
+      if (key == end) {
+        return false;
+      }
+      previous = KnapsackVarint<weight_type>::Sum(previous,
+        KnapsackVarint<weight_type>::Read(&key));
+      if (previous != *it) {
+        return false;
+      }
+    }
+    return (key == end);
+  }
+
+  // The header of the key stored at key
+  template <class Header>
+  static void ReadHeader(const unsigned char *key, Header *header) {
+    KnapsackVarint<size_type>::Read(&key);
+    KnapsackReadHeader(&key, header);
+  }
+
+  // The size of the key stored at key
+  static size_type Size(const unsigned char *key) {
+    size_type length(0), prefix(0);
+    for (unsigned int shift(0); ; shift += 7) {
+      unsigned char byte(key[prefix++]);
+      length |= (size_type(byte & 0x7F) << shift);
+      if ((byte & 0x80) == 0) {
+        return prefix + length;
+      }
+    }
+  }
+
+ private:
+  ByteList bytes_, data_;
+};
+
+// An append-only list of byte strings, allocated in chunks of at least
+// min_chunk bytes; a string never crosses a chunk. Strings are identified
+// by their position (chunk and offset); Truncate() allows to rewrite them.
+template <class Allocator>
+class KnapsackBytes {
+ public:
+  typedef std::size_t size_type;
+
+  KnapsackBytes(size_type min_chunk, const Allocator& allocator)
+    : chunk_(PointerAllocator(allocator)), allocator_(allocator),
+    chunk_size_(kChunkSize), end_(0) {
+    while (chunk_size_ < min_chunk) {
+      chunk_size_ *= 2;
+    }
+  }
+
+  ~KnapsackBytes() {
+    clear();
+  }
+
+  // The number of bytes used
+  std::size_t bytes() const {
+    return end_;
+  }
+
+  unsigned char *get(size_type position) {
+    return chunk_[position / chunk_size_] + (position % chunk_size_);
+  }
+
+  const unsigned char *get(size_type position) const {
+    return chunk_[position / chunk_size_] + (position % chunk_size_);
+  }
+
+  // Append data of the given size (at most min_chunk) and return its position
+  size_type Append(const unsigned char *data, size_type size) {
+    size_type offset(end_ % chunk_size_);
+    if ((offset != 0) && (chunk_size_ - offset < size)) {
+      end_ += chunk_size_ - offset;
+    }
+    if (end_ / chunk_size_ == chunk_.size()) {
+      chunk_.push_back(allocator_.allocate(chunk_size_));
+    }
+    size_type result(end_);
+    std::copy(data, data + size, get(result));
+    end_ += size;
+    return result;
+  }
+
+  // Forget all strings from position end on; the memory is kept for reuse.
+  // Strings can be appended from earlier positions, e.g. for compaction.
+  void Truncate(size_type end) {
+    end_ = end;
+  }
+
+  void clear() {
+    for (typename ChunkList::iterator it(chunk_.begin()); it != chunk_.end();
+      ++it) {
+      allocator_.deallocate(*it, chunk_size_);
+    }
+    chunk_.clear();
+    end_ = 0;
+  }
+
+ private:
+  typedef typename Allocator::template rebind<unsigned char>::other
+    ByteAllocator;
+  typedef typename Allocator::template rebind<unsigned char *>::other
+    PointerAllocator;
+  typedef std::vector<unsigned char *, PointerAllocator> ChunkList;
+  static const size_type kChunkSize = (size_type(1) << 16);
+
+  ChunkList chunk_;
+  ByteAllocator allocator_;
+  size_type chunk_size_, end_;
+
+  // This class is not meant to be copied
+  KnapsackBytes(const KnapsackBytes&);
+  KnapsackBytes& operator=(const KnapsackBytes&);
+};
+
+// A histogram of the costs of the entries of (several) tables.
+// Bucket i counts the costs c with 2^i <= c < 2^(i+1).
+class KnapsackCostHistogram {
+ public:
+  typedef boost::uint32_t cost_type;
+  typedef std::size_t size_type;
+  static const unsigned int kBuckets = 32;
+
+  KnapsackCostHistogram()
+    : total_(0) {
+    std::fill(count_, count_ + kBuckets, size_type(0));
+  }
+
+  void Add(cost_type cost) {
+    unsigned int bucket(0);
+    while ((cost >>= 1) != 0) {
+      ++bucket;
+    }
+    ++count_[bucket];
+    ++total_;
+  }
+
+  // The smallest power of 2 such that at least the given fraction (in
+  // percent) of the entries has a smaller cost
+  cost_type Threshold(unsigned int percent) const {
+    size_type sum(0);
+    for (unsigned int bucket(0); bucket != kBuckets - 1; ++bucket) {
+      sum += count_[bucket];
+      if (100 * sum >= percent * total_) {
+        return (cost_type(1) << (bucket + 1));
+      }
+    }
+    return (cost_type(1) << (kBuckets - 1));
+  }
+
+ private:
+  size_type count_[kBuckets];
+  size_type total_;
+};
+
+#ifndef KNAPSACK_BOOST_UNORDERED
+
+template <class State, class Header, class Entry, class Allocator>
+class KnapsackMemo {
+ public:
+  typedef typename State::weight_type weight_type;
+  typedef std::size_t size_type;
+
+  KnapsackMemo(size_type sacks, const Allocator& allocator)
+    : slots_(SlotAllocator(allocator)), hashes_(1, allocator),
+    costs_(1, allocator), entries_(1, allocator), positions_(1, allocator),
+    keys_(Key::MaxBytes(sacks), allocator), key_(allocator), mask_(0) {
+  }
+
+  typedef boost::uint32_t cost_type;
+
+  size_type size() const {
+    return entries_.size();
+  }
+
+  // The number of bytes used; this does not include memory which is kept
+  // for reuse after Evict()
+  std::size_t bytes() const {
+    return slots_.capacity() * sizeof(Slot) + size() * (sizeof(std::size_t) +
+      sizeof(Entry) + sizeof(cost_type) + sizeof(size_type)) + keys_.bytes();
+  }
+
+  void AddCosts(KnapsackCostHistogram *histogram) const {
+    for (size_type index(0); index != size(); ++index) {
+      histogram->Add(*(costs_.get(index)));
+    }
+  }
+
+  // Returns 0 if the state is not in the table
+  Entry *Find(std::size_t hash, const Header& header, const State& state) {
+    if (slots_.empty()) {
+      return KNAPSACK_NULLPTR;
+    }
+    boost::uint32_t tag(Tag(hash));
+    for (size_type i(hash & mask_); ; i = ((i + 1) & mask_)) {
+      const Slot& slot = slots_[i];
+      if (slot.index_ == 0) {
+        return KNAPSACK_NULLPTR;
+      }
+      if (slot.tag_ == tag) {
+        size_type index(slot.index_ - 1);
+        if (Key::Matches(keys_.get(*(positions_.get(index))), header,
+          state)) {
+          return entries_.get(index);
+        }
+      }
+    }
+  }
+
+  // The state must not be in the table.
+  // Returns the address of the stored entry which will never change.
+  Entry *Insert(std::size_t hash, const Header& header, const State& state,
+      const Entry& entry, cost_type cost) {
+    size_type index(entries_.size());
+    if (index >= kMaxIndex) {
+      throw std::length_error("knapsack: too many states");
+    }
+    if (4 * (index + 1) > 3 * slots_.size()) {
+      Grow();
+    }
+    *(hashes_.Append()) = hash;
+    *(costs_.Append()) = cost;
+    key_.assign(header, state);
+    *(positions_.Append()) = keys_.Append(key_.data(), key_.size());
+    Entry *result(new(entries_.Append()) Entry(entry));
+    Place(hash, index);
+    return result;
+  }
+
+  // Call (*visitor)(hash, key, entry) for all entries; key is the state in
+  // the format of KnapsackKey
+  template <class Visitor>
+  void Visit(Visitor *visitor) const {
+    for (size_type index(0); index != entries_.size(); ++index) {
+      (*visitor)(*(hashes_.get(index)), keys_.get(*(positions_.get(index))),
+        *(entries_.get(index)));
+    }
+  }
+
+  // Remove all entries of smaller cost and return their number
+  size_type Evict(cost_type min_cost) {
+    return Compact(CostAtLeast(*this, min_cost));
+  }
+
+  // Remove all entries whose header h satisfies remove(h) and return their
+  // number; as with Evict(), the remaining entries can move
+  template <class Predicate>
+  size_type RemoveIf(const Predicate& remove) {
+    return Compact(HeaderNot<Predicate>(*this, remove));
+  }
+
+  void clear() {
+    SlotList(slots_.get_allocator()).swap(slots_);
+    hashes_.clear();
+    costs_.clear();
+    entries_.clear();
+    positions_.clear();
+    keys_.clear();
+    mask_ = 0;
+  }
+
+ private:
+  typedef KnapsackKey<Allocator> Key;
+
+  class Slot {
+   public:
+    boost::uint32_t tag_;
+    boost::uint32_t index_;  // 0 means empty, otherwise index + 1
+
+    Slot()
+      : tag_(0), index_(0) {
+    }
+  };
+  typedef typename Allocator::template rebind<Slot>::other SlotAllocator;
+  typedef std::vector<Slot, SlotAllocator> SlotList;
+
+  static const size_type kMaxIndex = 0xFFFFFFFEU;
+
+  SlotList slots_;
+  KnapsackChunks<std::size_t, Allocator> hashes_;
+  KnapsackChunks<cost_type, Allocator> costs_;
+  KnapsackChunks<Entry, Allocator> entries_;
+  KnapsackChunks<size_type, Allocator> positions_;
+  KnapsackBytes<Allocator> keys_;
+  Key key_;  // the key of the last Insert()
+  size_type mask_;
+
+  // The lower bits of the hash determine the slot; use the upper bits
+  static boost::uint32_t Tag(std::size_t hash) {
+    boost::uint64_t h(hash);
+    return static_cast<boost::uint32_t>(h ^ (h >> 32));
+  }
+
+  // Keep only the entries with index for which keep(index) is true.
+  // The keys are appended again in the same order; since their positions
+  // can only decrease, no key is overwritten before it is copied.
+  template <class Keep>
+  size_type Compact(const Keep& keep) {
+    size_type size(entries_.size()), kept(0);
+    keys_.Truncate(0);
+    for (size_type index(0); index != size; ++index) {
+      if (!keep(index)) {
+        continue;
+      }
+      const unsigned char *key(keys_.get(*(positions_.get(index))));
+      *(positions_.get(kept)) = keys_.Append(key, Key::Size(key));
+      if (kept != index) {
+        *(hashes_.get(kept)) = *(hashes_.get(index));
+        *(costs_.get(kept)) = *(costs_.get(index));
+        *(entries_.get(kept)) = *(entries_.get(index));
+      }
+      ++kept;
+    }
+    hashes_.Truncate(kept);
+    costs_.Truncate(kept);
+    entries_.Truncate(kept);
+    positions_.Truncate(kept);
+    std::fill(slots_.begin(), slots_.end(), Slot());
+    for (size_type index(0); index != kept; ++index) {
+      Place(*(hashes_.get(index)), index);
+    }
+    return size - kept;
+  }
+
+  class CostAtLeast {
+   public:
+    CostAtLeast(const KnapsackMemo& memo, cost_type min_cost)
+      : memo_(memo), min_cost_(min_cost) {
+    }
+
+    bool operator()(size_type index) const {
+      return !(*(memo_.costs_.get(index)) < min_cost_);
+    }
+
+   private:
+    const KnapsackMemo& memo_;
+    cost_type min_cost_;
+  };
+
+  template <class Predicate>
+  class HeaderNot {
+   public:
+    HeaderNot(const KnapsackMemo& memo, const Predicate& remove)
+      : memo_(memo), remove_(remove) {
+    }
+
+    bool operator()(size_type index) const {
+      Header header;
+      Key::ReadHeader(memo_.keys_.get(*(memo_.positions_.get(index))),
+        &header);
+      return !remove_(header);
+    }
+
+   private:
+    const KnapsackMemo& memo_;
+    const Predicate& remove_;
+  };
+
+  void Place(std::size_t hash, size_type index) {
+    size_type i(hash & mask_);
+    while (slots_[i].index_ != 0) {
+      i = ((i + 1) & mask_);
+    }
+    Slot& slot = slots_[i];
+    slot.tag_ = Tag(hash);
+    slot.index_ = static_cast<boost::uint32_t>(index + 1);
+  }
+
+  void Grow() {
+    size_type capacity(slots_.empty() ? 1024 : (2 * slots_.size()));
+    SlotList(capacity, Slot(), slots_.get_allocator()).swap(slots_);
+    mask_ = capacity - 1;
+    for (size_type index(0); index != entries_.size(); ++index) {
+      Place(*(hashes_.get(index)), index);
+    }
+  }
+
+  // This class is not meant to be copied
+  KnapsackMemo(const KnapsackMemo&);
+  KnapsackMemo& operator=(const KnapsackMemo&);
+};
+
+#else  // KNAPSACK_BOOST_UNORDERED
+
+template <class State, class Header, class Entry, class Allocator>
+class KnapsackMemo {
+ public:
+  typedef std::size_t size_type;
+
+  typedef boost::uint32_t cost_type;
+
+  KnapsackMemo(size_type /* sacks */, const Allocator& allocator)
+    : map_(0, typename Map::hasher(), typename Map::key_equal(),
+      MapAllocator(allocator)) {
+  }
+
+  size_type size() const {
+    return map_.size();
+  }
+
+  // Only an estimate; the nodes are allocated individually
+  std::size_t bytes() const {
+    return map_.bucket_count() * sizeof(void *) +
+      map_.size() * (sizeof(typename Map::value_type) + 2 * sizeof(void *));
+  }
+
+  void AddCosts(KnapsackCostHistogram *histogram) const {
+    for (typename Map::const_iterator it(map_.begin()); it != map_.end();
+      ++it) {
+      histogram->Add(it->second.second);
+    }
+  }
+
+  Entry *Find(std::size_t hash, const Header& header, const State& state) {
+    typename Map::iterator found(map_.find(Probe(hash, header, state),
+      ProbeHash(), ProbeEqual()));
+    return ((found == map_.end()) ? KNAPSACK_NULLPTR :
+      &(found->second.first));
+  }
+
+  Entry *Insert(std::size_t hash, const Header& header, const State& state,
+      const Entry& entry, cost_type cost) {
+    return &(map_.insert(typename Map::value_type(Key(hash, header, state),
+      Mapped(entry, cost))).first->second.first);
+  }
+
+  template <class Visitor>
+  void Visit(Visitor *visitor) const {
+    KnapsackKey<MapAllocator> key(map_.get_allocator());
+    for (typename Map::const_iterator it(map_.begin()); it != map_.end();
+      ++it) {
+      key.assign(it->first.header_, it->first.state_);
+      (*visitor)(it->first.hash_, key.data(), it->second.first);
+    }
+  }
+
+  size_type Evict(cost_type min_cost) {
+    size_type size(map_.size());
+    for (typename Map::iterator it(map_.begin()); it != map_.end(); ) {
+      if (it->second.second < min_cost) {
+        it = map_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    return size - map_.size();
+  }
+
+  template <class Predicate>
+  size_type RemoveIf(const Predicate& remove) {
+    size_type size(map_.size());
+    for (typename Map::iterator it(map_.begin()); it != map_.end(); ) {
+      if (remove(it->first.header_)) {
+        it = map_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    return size - map_.size();
+  }
+
+  void clear() {
+    map_.clear();
+  }
+
+ private:
+  class Key {
+   public:
+    std::size_t hash_;
+    Header header_;
+    State state_;
+
+    Key(std::size_t hash, const Header& header, const State& state)
+      : hash_(hash), header_(header), state_(state) {
+    }
+
+    bool operator==(const Key& k) const {
+      return ((header_ == k.header_) && (state_ == k.state_));
+    }
+
+    friend std::size_t hash_value(const Key& k) {
+      return k.hash_;
+    }
+  };
+
+  class Probe {
+   public:
+    std::size_t hash_;
+    const Header& header_;
+    const State& state_;
+
+    Probe(std::size_t hash, const Header& header, const State& state)
+      : hash_(hash), header_(header), state_(state) {
+    }
+  };
+
+  class ProbeHash {
+   public:
+    std::size_t operator()(const Probe& p) const {
+      return p.hash_;
+    }
+  };
+
+  class ProbeEqual {
+   public:
+    bool operator()(const Probe& p, const Key& k) const {
+      return ((p.header_ == k.header_) && (p.state_ == k.state_));
+    }
+  };
+
+  typedef std::pair<Entry, cost_type> Mapped;
+  typedef typename Allocator::template rebind<std::pair<const Key, Mapped> >
+    ::other MapAllocator;
+  typedef boost::unordered_map<Key, Mapped, boost::hash<Key>,
+    std::equal_to<Key>, MapAllocator> Map;
+  Map map_;
+};
+
+#endif  // KNAPSACK_BOOST_UNORDERED
+
+#endif  // KNAPSACK_MEMO_TABLE_H_
@@ -0,0 +1,21 @@
+// This file is part of the knapsack project and distributed under the
+// terms of the GNU General Public License v2.
+// SPDX-License-Identifier: GPL-2.0-only
+//
+// Copyright (c)
+//   Martin Väth <martin@mvath.de>
+
+#ifndef KNAPSACK_NULLPTR_H_
+#define KNAPSACK_NULLPTR_H_ 1
+
+// The null pointer constant: nullptr if the compiler supports at least
+// C++11 (so that -Wzero-as-null-pointer-constant is silent), NULL otherwise
+
+#if __cplusplus >= 201103L
+#define KNAPSACK_NULLPTR nullptr
+#else
+#include <cstddef>  // NULL
+#define KNAPSACK_NULLPTR NULL
+#endif
+
+#endif  // KNAPSACK_NULLPTR_H_
@@ -0,0 +1,85 @@
+// This file is part of the knapsack project and distributed under the
+// terms of the GNU General Public License v2.
+// SPDX-License-Identifier: GPL-2.0-only
+//
+// Copyright (c)
+//   Martin Väth <martin@mvath.de>
+
+#ifndef KNAPSACK_PROGRESS_H_
+#define KNAPSACK_PROGRESS_H_ 1
+
+#include <csignal>  // std::sig_atomic_t
+#include <cstdlib>  // std::size_t
+
+#include "knapsack/deadline.h"
+#include "knapsack/nullptr.h"
+
+// The state of a running calculation which is passed to a KnapsackProgress
+// function: the seconds since the start, the number of states calculated
+// so far (by the calling thread), the number of entries and bytes of the
+// hashes, and, if have_incumbent_ is true, the value of the greedy solution
+// and the bound of the linear relaxation (the maximal value lies between).
+class KnapsackProgressInfo {
+ public:
+  double seconds_;
+  std::size_t states_, entries_, bytes_;
+  bool have_incumbent_;
+  long double incumbent_, bound_;
+
+  KnapsackProgressInfo()
+    : seconds_(0), states_(0), entries_(0), bytes_(0),
+    have_incumbent_(false), incumbent_(0), bound_(0) {
+  }
+};
+
+// A function which is called with the progress of a calculation when it
+// was requested (see KnapsackReporter); data is passed unchanged
+typedef void (*KnapsackProgress)(const KnapsackProgressInfo& info,
+  void *data);
+
+// The progress reporting of a calculation: The calculation regularly calls
+// Requested() which only reads *request, so that it needs neither locking
+// nor system calls. *request is meant to be set to a nonzero value by a
+// signal handler (e.g. of a timer). If it is nonzero, the calculation fills
+// a KnapsackProgressInfo and calls Report() which resets *request and calls
+// the KnapsackProgress function. The seconds are measured from the
+// construction.
+
+class KnapsackReporter {
+ public:
+  KnapsackReporter(KnapsackProgress progress,
+      volatile std::sig_atomic_t *request, void *data)
+    : progress_(progress), request_(request), data_(data),
+    clock_(-1, KNAPSACK_NULLPTR, KNAPSACK_NULLPTR), have_incumbent_(false),
+    incumbent_(0), bound_(0) {
+  }
+
+  bool Requested() const {
+    return (*request_ != 0);
+  }
+
+  void Report(KnapsackProgressInfo *info) const {
+    *request_ = 0;
+    info->seconds_ = clock_.Elapsed();
+    info->have_incumbent_ = have_incumbent_;
+    info->incumbent_ = incumbent_;
+    info->bound_ = bound_;
+    (*progress_)(*info, data_);
+  }
+
+  void set_incumbent(long double incumbent, long double bound) {
+    have_incumbent_ = true;
+    incumbent_ = incumbent;
+    bound_ = bound;
+  }
+
+ private:
+  KnapsackProgress progress_;
+  volatile std::sig_atomic_t *request_;
+  void *data_;
+  KnapsackDeadline clock_;
+  bool have_incumbent_;
+  long double incumbent_, bound_;
+};
+
+#endif  // KNAPSACK_PROGRESS_H_
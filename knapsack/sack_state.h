@@ -0,0 +1,187 @@
+// This file is part of the knapsack project and distributed under the
+// terms of the GNU General Public License v2.
+// SPDX-License-Identifier: GPL-2.0-only
+//
+// Copyright (c)
+//   Martin Väth <martin@mvath.de>
+
+#ifndef KNAPSACK_SACK_STATE_H_
+#define KNAPSACK_SACK_STATE_H_ 1
+
+#include <boost/cstdint.hpp>  // boost::uint64_t, UINT64_C
+#include <boost/functional/hash.hpp>  // boost::hash
+
+#include <algorithm>  // std::copy, std::equal
+#include <cstdlib>  // std::size_t
+#include <memory>  // std::allocator
+
+// A sorted list of residual capacities of the knapsacks.
+// The data is kept contiguously; up to Inline entries are stored within
+// the object itself so that the typical case needs no heap allocation;
+// larger lists are taken from Allocator (which Knapsack::Calc constructs
+// from the arena). The memory is only obtained anew if the list grows.
+// Modification is done by shifting the changed entry in place.
+// The hash value is the sum of a mixed hash of the entries; this is
+// independent of the order and can thus be updated in O(1) on modification.
+
+template <class Weight, class Allocator = std::allocator<Weight>,
+    std::size_t Inline = 16>
+class KnapsackState {
+ public:
+  typedef Weight weight_type;
+  typedef std::size_t size_type;
+  typedef const weight_type *const_iterator;
+  typedef Allocator allocator_type;
+
+  explicit KnapsackState(const Allocator& allocator = Allocator())
+    : size_(0), capacity_(Inline), hash_(0), data_(inline_),
+    allocator_(allocator) {
+  }
+
+  KnapsackState(const KnapsackState& s)
+    : size_(0), capacity_(Inline), hash_(s.hash_), data_(inline_),
+    allocator_(s.allocator_) {
+    Copy(s.begin(), s.end());
+  }
+
+  ~KnapsackState() {
+    Free();
+  }
+
+  KnapsackState& operator=(const KnapsackState& s) {
+    if (this != &s) {
+      Copy(s.begin(), s.end());
+      hash_ = s.hash_;
+    }
+    return *this;
+  }
+
+  // The range must be sorted
+  void assign(const_iterator first, const_iterator last) {
+    Copy(first, last);
+    hash_ = 0;
+    for (; first != last; ++first) {
+      hash_ += Mix(*first);
+    }
+  }
+
+  size_type size() const {
+    return size_;
+  }
+
+  const_iterator begin() const {
+    return data_;
+  }
+
+  const_iterator end() const {
+    return data_ + size_;
+  }
+
+  weight_type operator[](size_type pos) const {
+    return data_[pos];
+  }
+
+  // Change the entry at pos to value and shift it to the place where the
+  // list is sorted again; the new position is returned.
+  // Ties are resolved by order.Before(i, weight, value) which must return
+  // whether the entry at position i (of the passed weight) belongs before
+  // the changed entry; every shift of an entry from position i to position j
+  // is reported by order.Moved(i, j).
+  template <class Order>
+  size_type Replace(size_type pos, weight_type value, Order *order) {
+    weight_type *data(data_);
+    hash_ += Mix(value) - Mix(data[pos]);
+    if ((pos != 0) && !order->Before(pos - 1, data[pos - 1], value)) {
+      do {
+        data[pos] = data[pos - 1];
+        order->Moved(pos - 1, pos);
+      } while ((--pos != 0) && !order->Before(pos - 1, data[pos - 1], value));
+    } else {
+      for (size_type last(size_ - 1); (pos != last) &&
+        order->Before(pos + 1, data[pos + 1], value); ++pos) {
+        data[pos] = data[pos + 1];
+        order->Moved(pos + 1, pos);
+      }
+    }
+    data[pos] = value;
+    return pos;
+  }
+
+  // Store the list with the entries smaller than low replaced by 0 and the
+  // entries larger than high replaced by high in *result; this list is
+  // still sorted. If no entry changes, false is returned and *result is
+  // not modified.
+  bool Clamp(weight_type low, weight_type high, KnapsackState *result) const {
+    size_type pos(0);
+    for (; pos != size_; ++pos) {
+      weight_type weight(data_[pos]);
+      if (((weight < low) && (weight != 0)) || (weight > high)) {
+        break;
+      }
+    }
+    if (pos == size_) {
+      return false;
+    }
+    result->Copy(begin(), end());
+    result->hash_ = 0;
+    for (pos = 0; pos != size_; ++pos) {
+      weight_type& weight = result->data_[pos];
+      if (weight < low) {
+        weight = 0;
+      } else if (weight > high) {
+        weight = high;
+      }
+      result->hash_ += Mix(weight);
+    }
+    return true;
+  }
+
+  bool operator==(const KnapsackState& s) const {
+    return ((hash_ == s.hash_) && (size_ == s.size_) &&
+      std::equal(begin(), end(), s.begin()));
+  }
+
+  std::size_t get_hash() const {
+    return hash_;
+  }
+
+  friend std::size_t hash_value(const KnapsackState& s) {
+    return s.hash_;
+  }
+
+ private:
+  size_type size_, capacity_;
+  std::size_t hash_;
+  weight_type *data_;
+  weight_type inline_[Inline];
+  Allocator allocator_;
+
+  // The finalizer of splitmix64: Similar weights get unrelated summands
+  static std::size_t Mix(weight_type weight) {
+    boost::uint64_t x(boost::hash<weight_type>()(weight));
+    x = (x ^ (x >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+    x = (x ^ (x >> 27)) * UINT64_C(0x94D049BB133111EB);
+    return static_cast<std::size_t>(x ^ (x >> 31));
+  }
+
+  void Copy(const_iterator first, const_iterator last) {
+    size_type size(static_cast<size_type>(last - first));
+    if (size > capacity_) {
+      Free();
+      data_ = allocator_.allocate(size);
+      capacity_ = size;
+    }
+    size_ = size;
+    std::copy(first, last, data_);
+  }
+
+  void Free() {
+    if (data_ != inline_) {
+      allocator_.deallocate(data_, capacity_);
+      data_ = inline_;
+      capacity_ = Inline;
+    }
+  }
+};
+
+#endif  // KNAPSACK_SACK_STATE_H_
@@ -0,0 +1,156 @@
+// This file is part of the knapsack project and distributed under the
+// terms of the GNU General Public License v2.
+// SPDX-License-Identifier: GPL-2.0-only
+//
+// Copyright (c)
+//   Martin Väth <martin@mvath.de>
+
+#ifndef KNAPSACK_STATS_H_
+#define KNAPSACK_STATS_H_ 1
+
+#include <boost/format.hpp>  // boost::format
+
+#include <cstdlib>  // std::size_t
+
+#include <string>
+
+#include "knapsack/deadline.h"
+#include "knapsack/nullptr.h"
+
+#ifndef KNAPSACK_NO_STATS
+#define KNAPSACK_STATS 1
+#endif
+
+// The statistics of the last Knapsack::Solve() (see get_stats()): For the
+// hash engine, the number of states inserted into and looked up in the
+// hashes of unbound and bound states (hits include states of the memo
+// file), the largest depth of the stack of frames, and the bytes of the
+// hashes at the end; for all engines, the seconds spent for preprocessing,
+// for the calculation of the maximal value, and for the reconstruction
+// of the solution (with the resolution of KnapsackDeadline). Only the hash
+// engine reconstructs the solution separately; for the other engines, this
+// is included in the calculation.
+// If KNAPSACK_NO_STATS is defined, the counting functions are empty so that
+// the calculation is not slowed down, and all numbers remain 0.
+
+class KnapsackStats {
+ public:
+  std::size_t unbound_states_, bound_states_;
+  std::size_t unbound_lookups_, bound_lookups_;
+  std::size_t unbound_hits_, bound_hits_;
+  std::size_t max_depth_;
+  std::size_t unbound_bytes_, bound_bytes_;
+  double preprocess_seconds_, search_seconds_, decide_seconds_;
+
+  KnapsackStats() {
+    clear();
+  }
+
+  void clear() {
+    unbound_states_ = bound_states_ = 0;
+    unbound_lookups_ = bound_lookups_ = 0;
+    unbound_hits_ = bound_hits_ = 0;
+    max_depth_ = 0;
+    unbound_bytes_ = bound_bytes_ = 0;
+    preprocess_seconds_ = search_seconds_ = decide_seconds_ = 0;
+  }
+
+  // Count a lookup in the hashes and whether the state was found
+#ifdef KNAPSACK_STATS
+  void Lookup(bool unbound, bool hit) {
+    if (unbound) {
+      ++unbound_lookups_;
+      if (hit) {
+        ++unbound_hits_;
+      }
+    } else {
+      ++bound_lookups_;
+      if (hit) {
+        ++bound_hits_;
+      }
+    }
+  }
+#else
+  void Lookup(bool /* unbound */, bool /* hit */) {
+  }
+#endif
+
+  // Count a state inserted into the hashes
+#ifdef KNAPSACK_STATS
+  void Insert(bool unbound) {
+    ++(unbound ? unbound_states_ : bound_states_);
+  }
+#else
+  void Insert(bool /* unbound */) {
+  }
+#endif
+
+  // Note the current depth of the stack of frames
+#ifdef KNAPSACK_STATS
+  void Depth(std::size_t depth) {
+    if (max_depth_ < depth) {
+      max_depth_ = depth;
+    }
+  }
+#else
+  void Depth(std::size_t /* depth */) {
+  }
+#endif
+
+  // Add the numbers of other (e.g. of another thread or calculation);
+  // only the maximal depth is not added
+  void Add(const KnapsackStats& other) {
+    unbound_states_ += other.unbound_states_;
+    bound_states_ += other.bound_states_;
+    unbound_lookups_ += other.unbound_lookups_;
+    bound_lookups_ += other.bound_lookups_;
+    unbound_hits_ += other.unbound_hits_;
+    bound_hits_ += other.bound_hits_;
+    Depth(other.max_depth_);
+    unbound_bytes_ += other.unbound_bytes_;
+    bound_bytes_ += other.bound_bytes_;
+    preprocess_seconds_ += other.preprocess_seconds_;
+    search_seconds_ += other.search_seconds_;
+    decide_seconds_ += other.decide_seconds_;
+  }
+
+  // Append the numbers as name=value pairs separated by spaces
+  void Append(std::string *str) const {
+    str->append((boost::format("unbound_states=%s bound_states=%s "
+      "unbound_lookups=%s bound_lookups=%s unbound_hits=%s bound_hits=%s "
+      "max_depth=%s unbound_bytes=%s bound_bytes=%s preprocess_seconds=%s "
+      "search_seconds=%s decide_seconds=%s") % unbound_states_ %
+      bound_states_ % unbound_lookups_ % bound_lookups_ % unbound_hits_ %
+      bound_hits_ % max_depth_ % unbound_bytes_ % bound_bytes_ %
+      preprocess_seconds_ % search_seconds_ % decide_seconds_).str());
+  }
+
+  // Add the seconds of its lifetime to *seconds
+  class Timer {
+   public:
+#ifdef KNAPSACK_STATS
+    explicit Timer(double *seconds)
+      : seconds_(seconds), clock_(-1, KNAPSACK_NULLPTR, KNAPSACK_NULLPTR) {
+    }
+
+    ~Timer() {
+      *seconds_ += clock_.Elapsed();
+    }
+#else
+    explicit Timer(double * /* seconds */) {
+    }
+#endif
+
+   private:
+#ifdef KNAPSACK_STATS
+    double *seconds_;
+    KnapsackDeadline clock_;
+#endif
+
+    // This class is not meant to be copied
+    Timer(const Timer&);
+    Timer& operator=(const Timer&);
+  };
+};
+
+#endif  // KNAPSACK_STATS_H_
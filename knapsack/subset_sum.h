@@ -0,0 +1,218 @@
+// This file is part of the knapsack project and distributed under the
+// terms of the GNU General Public License v2.
+// SPDX-License-Identifier: GPL-2.0-only
+//
+// Copyright (c)
+//   Martin Väth <martin@mvath.de>
+
+#ifndef KNAPSACK_SUBSET_SUM_H_
+#define KNAPSACK_SUBSET_SUM_H_ 1
+
+#include <boost/cstdint.hpp>  // boost::uint64_t
+
+#include <algorithm>  // std::copy
+#include <cstdlib>  // std::size_t
+
+#include <vector>
+
+// The bitset engine for one or two knapsacks when the value of each item is
+// its weight (subset sum): Instead of values, only the sets of reachable
+// sums are stored as bitsets, and adding an item is a shift and or of words.
+// A sum consists of the used capacities u_first, u_last of the knapsacks
+// (first is the knapsack with index 0, last the one with the highest index;
+// for one knapsack, u_first is always 0). The bitset has a row for each
+// u_first; each row starts at a new word.
+//
+// Each set is a layer: Layer 0 contains only the empty sum.
+// For each bound item (added in reverse order), a layer is added for each
+// count c, containing the sums of the items added so far when this item is
+// used at most c times. After all bound items, the unbound items are added
+// in a single layer.
+// The value of a state with residual capacities (r_first, r_last) for a
+// layer is the largest sum u_first + u_last with u_first <= r_first and
+// u_last <= r_last; this is the same value as for the other engines so that
+// the decisions (and ties) can be made the same way.
+
+template <class Allocator>
+class KnapsackSubsetSum {
+ public:
+  typedef std::size_t size_type;
+  typedef boost::uint64_t word_type;
+
+  // layers is the number of layers which are added (for reserving memory)
+  KnapsackSubsetSum(size_type rows, size_type width, size_type layers,
+      const Allocator& allocator)
+    : rows_(rows), width_(width), stride_((width + kWordBits - 1) / kWordBits),
+    layer_words_(rows * stride_), bits_(WordAllocator(allocator)),
+    layers_(1) {
+    bits_.reserve((layers + 1) * layer_words_);
+    bits_.resize(layer_words_, word_type(0));
+    bits_[0] = 1;
+    size_type rest(width_ % kWordBits);
+    last_mask_ = ((rest == 0) ? ~word_type(0) :
+      ((word_type(1) << rest) - 1));
+  }
+
+  // The approximate number of bytes needed for the given number of layers
+  static long double Bytes(size_type rows, size_type width,
+      size_type layers) {
+    long double words(static_cast<long double>(rows) *
+      static_cast<long double>((width + kWordBits - 1) / kWordBits));
+    return (words * static_cast<long double>(layers + 1) * sizeof(word_type));
+  }
+
+  // The index of the last layer added so far
+  size_type get_layer() const {
+    return layers_ - 1;
+  }
+
+  // Add a bound item which can be used count times (count must be positive).
+  // Returns the index of the first layer: The layer for count c
+  // (1 <= c <= count) has index result + c - 1, and that for count 0 has
+  // index result - 1.
+  size_type AddBound(size_type weight, size_type count) {
+    size_type skip(layers_ - 1), result(layers_);
+    for (size_type c(0); c != count; ++c, ++layers_) {
+      bits_.resize((layers_ + 1) * layer_words_, word_type(0));
+      word_type *current(Layer(layers_));
+      const word_type *base(Layer(skip));
+      std::copy(base, base + layer_words_, current);
+      Shift(Layer(layers_ - 1), weight, current);
+    }
+    return result;
+  }
+
+  // Add all unbound items after the bound items. Returns the new layer.
+  // Each item is added (to each knapsack) 1, 2, 4, ... times.
+  size_type AddUnbound(const size_type *weight, size_type count) {
+    bits_.resize((layers_ + 1) * layer_words_, word_type(0));
+    word_type *current(Layer(layers_));
+    const word_type *base(Layer(layers_ - 1));
+    std::copy(base, base + layer_words_, current);
+    for (size_type i(0); i != count; ++i) {
+      for (size_type shift(weight[i]); shift < width_; shift *= 2) {
+        for (size_type row(rows_); row != 0; ) {
+          --row;
+          ShiftRow(Row(current, row), shift, Row(current, row));
+        }
+      }
+      for (size_type shift(weight[i]); shift < rows_; shift *= 2) {
+        for (size_type row(rows_); row != shift; ) {
+          --row;
+          OrRow(Row(current, row - shift), Row(current, row));
+        }
+      }
+    }
+    return layers_++;
+  }
+
+  // The largest sum of layer in the state with the residual capacities
+  // first and last (see above)
+  size_type Best(size_type layer, size_type first, size_type last) const {
+    const word_type *bits(Layer(layer));
+    size_type result(0);
+    for (size_type row(first + 1); row != 0; ) {
+      --row;
+      if (row + last <= result) {
+        break;
+      }
+      size_type found;
+      if (Highest(Row(bits, row), last, &found) && (row + found > result)) {
+        result = row + found;
+      }
+    }
+    return result;
+  }
+
+ private:
+  typedef typename Allocator::template rebind<word_type>::other
+    WordAllocator;
+  typedef std::vector<word_type, WordAllocator> WordList;
+
+  static const size_type kWordBits = 64;
+
+  size_type rows_, width_, stride_, layer_words_;
+  word_type last_mask_;  // the valid bits of the last word of a row
+  WordList bits_;
+  size_type layers_;
+
+  word_type *Layer(size_type layer) {
+    return &bits_[layer * layer_words_];
+  }
+
+  const word_type *Layer(size_type layer) const {
+    return &bits_[layer * layer_words_];
+  }
+
+  word_type *Row(word_type *bits, size_type row) const {
+    return bits + row * stride_;
+  }
+
+  const word_type *Row(const word_type *bits, size_type row) const {
+    return bits + row * stride_;
+  }
+
+  // current |= (prev shifted by weight in each of the knapsacks)
+  void Shift(const word_type *prev, size_type weight, word_type *current) {
+    for (size_type row(0); row != rows_; ++row) {
+      ShiftRow(Row(prev, row), weight, Row(current, row));
+    }
+    for (size_type row(weight); row < rows_; ++row) {
+      OrRow(Row(prev, row - weight), Row(current, row));
+    }
+  }
+
+  // to |= (from << shift) for a row; from == to is admissible since the
+  // words are processed from the highest one
+  void ShiftRow(const word_type *from, size_type shift, word_type *to) const {
+    size_type words(shift / kWordBits), bits(shift % kWordBits);
+    if (words >= stride_) {
+      return;
+    }
+    for (size_type i(stride_ - 1); ; --i) {
+      size_type source(i - words);
+      word_type value(from[source] << bits);
+      if ((bits != 0) && (source != 0)) {
+        value |= from[source - 1] >> (kWordBits - bits);
+      }
+      to[i] |= value;
+      if (source == 0) {
+        break;
+      }
+    }
+    to[stride_ - 1] &= last_mask_;
+  }
+
+  void OrRow(const word_type *from, word_type *to) const {
+    for (size_type i(0); i != stride_; ++i) {
+      to[i] |= from[i];
+    }
+  }
+
+  // Store the highest bit <= last of row in *found. Returns false if none
+  bool Highest(const word_type *row, size_type last, size_type *found) const {
+    size_type i(last / kWordBits), bit(last % kWordBits);
+    word_type word(row[i]);
+    if (bit != kWordBits - 1) {
+      word &= (word_type(1) << (bit + 1)) - 1;
+    }
+    while (word == 0) {
+      if (i == 0) {
+        return false;
+      }
+      word = row[--i];
+    }
+    size_type result(kWordBits - 1);
+    while ((word >> result) == 0) {
+      --result;
+    }
+    *found = i * kWordBits + result;
+    return true;
+  }
+
+  // This class is not meant to be copied
+  KnapsackSubsetSum(const KnapsackSubsetSum&);
+  KnapsackSubsetSum& operator=(const KnapsackSubsetSum&);
+};
+
+#endif  // KNAPSACK_SUBSET_SUM_H_